@@ -0,0 +1,117 @@
+/* Skeltrack Desktop Control: Allocation Counter
+ *
+ * Copyright (c) 2012 Igalia, S.L.
+ *
+ * Author: Joaquim Rocha <jrocha@igalia.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/* Counts the heap allocations each thread makes, to check that code
+   meant to run every frame does not allocate once it is warmed up.
+
+   It is only built with --enable-alloc-counter because it replaces
+   malloc and friends for the whole program (forwarding them to glibc's
+   own implementation). GSlice keeps its own caches on top of malloc, so
+   run with G_SLICE=always-malloc to see its allocations as well. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "alloc-counter.h"
+
+#ifdef ENABLE_ALLOC_COUNTER
+
+#include <errno.h>
+#include <stddef.h>
+
+extern void *__libc_malloc (size_t size);
+extern void *__libc_calloc (size_t n_members, size_t size);
+extern void *__libc_realloc (void *ptr, size_t size);
+extern void *__libc_memalign (size_t alignment, size_t size);
+
+static __thread guint n_allocations = 0;
+
+void *
+malloc (size_t size)
+{
+  n_allocations++;
+  return __libc_malloc (size);
+}
+
+void *
+calloc (size_t n_members, size_t size)
+{
+  n_allocations++;
+  return __libc_calloc (n_members, size);
+}
+
+void *
+realloc (void *ptr, size_t size)
+{
+  n_allocations++;
+  return __libc_realloc (ptr, size);
+}
+
+void *
+memalign (size_t alignment, size_t size)
+{
+  n_allocations++;
+  return __libc_memalign (alignment, size);
+}
+
+void *
+aligned_alloc (size_t alignment, size_t size)
+{
+  n_allocations++;
+  return __libc_memalign (alignment, size);
+}
+
+int
+posix_memalign (void **ptr, size_t alignment, size_t size)
+{
+  n_allocations++;
+  *ptr = __libc_memalign (alignment, size);
+  return *ptr != NULL ? 0 : ENOMEM;
+}
+
+gboolean
+alloc_counter_is_enabled (void)
+{
+  return TRUE;
+}
+
+guint
+alloc_counter_get (void)
+{
+  return n_allocations;
+}
+
+#else
+
+gboolean
+alloc_counter_is_enabled (void)
+{
+  return FALSE;
+}
+
+guint
+alloc_counter_get (void)
+{
+  return 0;
+}
+
+#endif
@@ -0,0 +1,811 @@
+/* Skeltrack Desktop Control: Batch
+ *
+ * Copyright (c) 2012 Igalia, S.L.
+ *
+ * Author: Joaquim Rocha <jrocha@igalia.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/* Runs recordings through the whole pipeline, with as many sets of
+   parameters as wanted, as fast as the machine can, to tune the
+   gestures. What to run is described by a key file:
+
+     [batch]
+     # Relative to this file
+     recordings=monday.skdr;tuesday.skdr
+     # Where the results go (default: the current directory)
+     output=results
+     # Optional
+     templates=templates.ini
+     threads=8
+     # How far from the expected time an event can be, in milliseconds
+     tolerance=250
+     screen=1920x1080
+
+     # Every other group is a set of parameters: the gestures' settings
+     # (see GestureConfig) plus threshold_begin, threshold_end and
+     # dimension_reduction. A list of values makes one set for each,
+     # and for each combination when there are several lists.
+     [pinch]
+     double_hand_wheel_mode=0
+     pinch_activate_distance=150;200;250;300
+
+   Each recording is run with each set on a pool of threads with one
+   Skeltrack, gesture state and recognizer per thread. The events each
+   run produced are written to OUTPUT/RECORDING.SET.events, one per line:
+
+     <seconds since the first frame> <type> <key or button> <x> <y>
+
+   If there is a RECORDING.expected file in that same format, e.g. a
+   reviewed .events file, the press and release events (motion is
+   ignored) are matched with it to tell how many were found and how
+   late. A summary of every run is printed and written to
+   OUTPUT/summary.tsv. */
+
+#include "batch.h"
+#include "depth-pyramid.h"
+#include "depth-recording.h"
+#include "dtw-recognizer.h"
+#include "gestures.h"
+#include "input-event.h"
+#include "work-pool.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <skeltrack.h>
+
+#define BATCH_GROUP "batch"
+#define DEFAULT_TOLERANCE 250
+#define RESERVED_EVENTS 4096
+
+typedef struct
+{
+  gchar *name;
+  GestureConfig config;
+  gint threshold_begin;
+  gint threshold_end;
+  /* 0 for Skeltrack's default */
+  gint dimension_reduction;
+} ParamSet;
+
+/* Every parameter is stored as an int in a ParamSet */
+typedef struct
+{
+  const gchar *key;
+  gsize offset;
+} ParamKey;
+
+#define CONFIG_KEY(name) { #name, G_STRUCT_OFFSET (ParamSet, config.name) }
+#define SET_KEY(name) { #name, G_STRUCT_OFFSET (ParamSet, name) }
+
+static const ParamKey param_keys[] =
+{
+  CONFIG_KEY (threshold),
+  CONFIG_KEY (action_half_width),
+  CONFIG_KEY (action_above),
+  CONFIG_KEY (action_below),
+  CONFIG_KEY (timeout),
+  CONFIG_KEY (double_hand_wheel_mode),
+  CONFIG_KEY (grab_mode),
+  CONFIG_KEY (wheel_turn_activate_distance),
+  CONFIG_KEY (pinch_activate_distance),
+  CONFIG_KEY (pointer_width),
+  CONFIG_KEY (pointer_height),
+  CONFIG_KEY (pointer_offset),
+  SET_KEY (threshold_begin),
+  SET_KEY (threshold_end),
+  SET_KEY (dimension_reduction)
+};
+
+static const gchar *event_names[] =
+{
+  "motion",
+  "key-press",
+  "key-release",
+  "button-press",
+  "button-release"
+};
+
+typedef struct
+{
+  const gchar *recording;
+  const ParamSet *params;
+
+  gchar *error_message;
+  guint n_frames;
+  guint n_tracked;
+  gdouble duration;
+  GArray *events;
+  /* Time taken by each frame, in microseconds */
+  GArray *frame_times;
+
+  gboolean has_expected;
+  guint n_expected;
+  guint n_produced;
+  guint n_matched;
+  gint64 total_delay;
+} BatchJob;
+
+typedef struct
+{
+  GestureState *gestures;
+  DtwRecognizer *recognizer;
+  DepthPyramidPool *pyramids;
+} BatchWorker;
+
+typedef struct
+{
+  gchar *output;
+  gint tolerance;
+  guint screen_width;
+  guint screen_height;
+} Batch;
+
+static gboolean
+parse_screen (const gchar *size, guint *width, guint *height)
+{
+  gchar *end;
+
+  *width = g_ascii_strtoull (size, &end, 10);
+  if (*width == 0 || *end != 'x')
+    return FALSE;
+  *height = g_ascii_strtoull (end + 1, &end, 10);
+
+  return *end == '\0' && *height > 0;
+}
+
+static void
+param_set_set (ParamSet *set, const ParamKey *key, gint value)
+{
+  *(gint *) ((guint8 *) set + key->offset) = value;
+}
+
+/* Adds a set to SETS for each combination of the values in GROUP */
+static gboolean
+add_param_sets (GKeyFile        *file,
+                const gchar     *group,
+                const ParamSet  *defaults,
+                GPtrArray       *sets,
+                GError         **error)
+{
+  gchar **keys;
+  const ParamKey **found;
+  gint **values;
+  gsize *n_values, n_keys, i;
+  guint *current;
+  gboolean valid = TRUE;
+
+  keys = g_key_file_get_keys (file, group, &n_keys, error);
+  if (keys == NULL)
+    return FALSE;
+
+  found = g_new0 (const ParamKey *, n_keys);
+  values = g_new0 (gint *, n_keys);
+  n_values = g_new0 (gsize, n_keys);
+  current = g_new0 (guint, n_keys);
+
+  for (i = 0; valid && i < n_keys; i++)
+    {
+      guint k;
+
+      for (k = 0; k < G_N_ELEMENTS (param_keys); k++)
+        if (g_strcmp0 (keys[i], param_keys[k].key) == 0)
+          found[i] = &param_keys[k];
+
+      if (found[i] == NULL)
+        {
+          g_set_error (error, G_KEY_FILE_ERROR,
+                       G_KEY_FILE_ERROR_KEY_NOT_FOUND,
+                       "Unknown parameter %s in [%s]", keys[i], group);
+          valid = FALSE;
+          break;
+        }
+
+      values[i] = g_key_file_get_integer_list (file, group, keys[i],
+                                               &n_values[i], error);
+      valid = values[i] != NULL && n_values[i] > 0;
+    }
+
+  /* Counts through every combination, the first key changing fastest */
+  while (valid)
+    {
+      ParamSet *set;
+      GString *name;
+
+      set = g_slice_new (ParamSet);
+      *set = *defaults;
+      name = g_string_new (group);
+      for (i = 0; i < n_keys; i++)
+        {
+          param_set_set (set, found[i], values[i][current[i]]);
+          if (n_values[i] > 1)
+            g_string_append_printf (name, "-%s=%d",
+                                    keys[i], values[i][current[i]]);
+        }
+      set->name = g_string_free (name, FALSE);
+      g_ptr_array_add (sets, set);
+
+      for (i = 0; i < n_keys; i++)
+        {
+          if (++current[i] < n_values[i])
+            break;
+          current[i] = 0;
+        }
+      if (i == n_keys)
+        break;
+    }
+
+  for (i = 0; i < n_keys; i++)
+    g_free (values[i]);
+  g_free (values);
+  g_free (n_values);
+  g_free (current);
+  g_free (found);
+  g_strfreev (keys);
+
+  return valid;
+}
+
+static void
+param_set_free (ParamSet *set)
+{
+  g_free (set->name);
+  g_slice_free (ParamSet, set);
+}
+
+static void
+recognize_templates (BatchWorker *worker, SkeltrackJointList joints)
+{
+  DtwMatch match;
+
+  if (! dtw_recognizer_feed (worker->recognizer, joints, &match))
+    return;
+
+  if (match.action->type == DTW_ACTION_KEYS)
+    gesture_state_send_keys (worker->gestures,
+                             match.action->codes,
+                             match.action->n_codes);
+  else
+    gesture_state_click (worker->gestures, match.action->codes[0]);
+}
+
+static gboolean
+write_events (BatchJob     *job,
+              const gchar  *filename,
+              gint64        start,
+              GError      **error)
+{
+  GString *text;
+  gboolean written;
+  guint i;
+
+  text = g_string_new (NULL);
+  for (i = 0; i < job->events->len; i++)
+    {
+      const InputEvent *event = &g_array_index (job->events, InputEvent, i);
+
+      g_string_append_printf (text, "%.3f %s %u %d %d\n",
+                              (event->time - start) / 1e6,
+                              event_names[event->type],
+                              event->code,
+                              event->x,
+                              event->y);
+    }
+
+  written = g_file_set_contents (filename, text->str, text->len, error);
+  g_string_free (text, TRUE);
+
+  return written;
+}
+
+/* The press and release events in FILENAME, with their time relative
+   to the first frame, or NULL if there is no such file */
+static GArray *
+read_expected (const gchar *filename)
+{
+  GArray *events;
+  gchar *contents, **lines;
+  guint i;
+
+  if (! g_file_get_contents (filename, &contents, NULL, NULL))
+    return NULL;
+
+  events = g_array_new (FALSE, FALSE, sizeof (InputEvent));
+  lines = g_strsplit (contents, "\n", -1);
+  for (i = 0; lines[i] != NULL; i++)
+    {
+      InputEvent event;
+      gdouble time;
+      gchar type[32];
+      guint t;
+
+      if (sscanf (lines[i], "%lf %31s %u", &time, type, &event.code) != 3)
+        continue;
+
+      for (t = 0; t < G_N_ELEMENTS (event_names); t++)
+        if (strcmp (type, event_names[t]) == 0)
+          break;
+      if (t == INPUT_EVENT_MOTION || t == G_N_ELEMENTS (event_names))
+        continue;
+
+      event.type = t;
+      event.time = time * 1e6;
+      event.x = 0;
+      event.y = 0;
+      g_array_append_val (events, event);
+    }
+  g_strfreev (lines);
+  g_free (contents);
+
+  return events;
+}
+
+/* Matches each expected event with the first one produced of the same
+   kind, not matched yet, within the tolerance */
+static void
+compare_events (BatchJob     *job,
+                const GArray *expected,
+                gint64        start,
+                gint64        tolerance)
+{
+  gboolean *matched;
+  guint i, j;
+
+  job->has_expected = TRUE;
+  job->n_expected = expected->len;
+
+  matched = g_new0 (gboolean, job->events->len);
+  for (j = 0; j < job->events->len; j++)
+    if (g_array_index (job->events, InputEvent, j).type != INPUT_EVENT_MOTION)
+      job->n_produced++;
+
+  for (i = 0; i < expected->len; i++)
+    {
+      const InputEvent *want = &g_array_index (expected, InputEvent, i);
+
+      for (j = 0; j < job->events->len; j++)
+        {
+          const InputEvent *got = &g_array_index (job->events, InputEvent, j);
+          gint64 delay = got->time - start - want->time;
+
+          if (matched[j] || got->type != want->type ||
+              got->code != want->code || ABS (delay) > tolerance)
+            continue;
+
+          matched[j] = TRUE;
+          job->n_matched++;
+          job->total_delay += delay;
+          break;
+        }
+    }
+
+  g_free (matched);
+}
+
+static void
+run_job (gpointer data, gpointer worker_data, gpointer user_data)
+{
+  BatchJob *job = data;
+  BatchWorker *worker = worker_data;
+  Batch *batch = user_data;
+  const ParamSet *params = job->params;
+  DepthPlayer *player;
+  SkeltrackSkeleton *skeleton;
+  const InputEvent *events;
+  GArray *expected;
+  gchar *base, *name, *filename;
+  guint i, width, height, n_events;
+  gint factor;
+  gint64 start = 0;
+  GError *error = NULL;
+
+  player = depth_player_new (job->recording, &error);
+  if (player == NULL)
+    {
+      job->error_message = g_strdup (error->message);
+      g_error_free (error);
+      return;
+    }
+
+  /* A new one for every run, so that what it remembers of the last
+     frames does not depend on the runs the worker did before */
+  skeleton = SKELTRACK_SKELETON (skeltrack_skeleton_new ());
+  if (params->dimension_reduction > 0)
+    g_object_set (skeleton,
+                  "dimension-reduction", params->dimension_reduction,
+                  NULL);
+  g_object_get (skeleton, "dimension-reduction", &factor, NULL);
+
+  *gesture_state_get_config (worker->gestures) = params->config;
+  gesture_state_reset (worker->gestures);
+  gesture_state_clear_events (worker->gestures);
+  dtw_recognizer_reset (worker->recognizer);
+
+  depth_player_get_size (player, &width, &height);
+  job->n_frames = depth_player_get_n_frames (player);
+  job->frame_times = g_array_sized_new (FALSE, FALSE, sizeof (gint64),
+                                        job->n_frames);
+  if (job->n_frames > 0)
+    {
+      start = depth_player_get_timestamp (player, 0);
+      job->duration = (depth_player_get_timestamp (player,
+                                                   job->n_frames - 1) -
+                       start) / 1e6;
+    }
+
+  for (i = 0; i < job->n_frames; i++)
+    {
+      const guint16 *depth;
+      DepthPyramid *pyramid;
+      const DepthLevel *reduced;
+      SkeltrackJointList joints;
+      gint64 frame_start, frame_time;
+
+      depth = depth_player_get_frame (player, i, &error);
+      if (depth == NULL)
+        {
+          job->error_message = g_strdup_printf ("Frame %u: %s",
+                                                i, error->message);
+          g_error_free (error);
+          break;
+        }
+
+      frame_start = g_get_monotonic_time ();
+      pyramid = depth_pyramid_pool_get (worker->pyramids,
+                                        width, height, factor);
+      depth_pyramid_build (pyramid,
+                           depth,
+                           params->threshold_begin,
+                           params->threshold_end);
+      reduced = depth_pyramid_get_level (pyramid, factor);
+
+      joints = skeltrack_skeleton_track_joints_sync (skeleton,
+                                                     reduced->data,
+                                                     reduced->width,
+                                                     reduced->height,
+                                                     NULL,
+                                                     &error);
+      if (error != NULL)
+        {
+          g_error_free (error);
+          error = NULL;
+        }
+      else if (joints != NULL)
+        {
+          if (skeltrack_joint_list_get_joint (joints,
+                                              SKELTRACK_JOINT_ID_HEAD) != NULL)
+            job->n_tracked++;
+
+          gesture_state_interpret (worker->gestures,
+                                   joints,
+                                   depth_pyramid_get_level (pyramid, 1)->data,
+                                   width,
+                                   height,
+                                   depth_player_get_timestamp (player, i));
+          recognize_templates (worker, joints);
+          skeltrack_joint_list_free (joints);
+        }
+
+      depth_pyramid_release (pyramid);
+      frame_time = g_get_monotonic_time () - frame_start;
+      g_array_append_val (job->frame_times, frame_time);
+    }
+
+  events = gesture_state_get_events (worker->gestures, &n_events);
+  job->events = g_array_sized_new (FALSE, FALSE, sizeof (InputEvent),
+                                   n_events);
+  g_array_append_vals (job->events, events, n_events);
+
+  base = g_path_get_basename (job->recording);
+  name = g_strdup_printf ("%s.%s.events", base, params->name);
+  filename = g_build_filename (batch->output, name, NULL);
+  if (! write_events (job, filename, start, &error))
+    {
+      g_free (job->error_message);
+      job->error_message = g_strdup (error->message);
+      g_error_free (error);
+    }
+  g_free (filename);
+  g_free (name);
+  g_free (base);
+
+  filename = g_strconcat (job->recording, ".expected", NULL);
+  expected = read_expected (filename);
+  if (expected != NULL)
+    {
+      compare_events (job, expected, start, batch->tolerance * 1000);
+      g_array_free (expected, TRUE);
+    }
+  g_free (filename);
+
+  g_object_unref (skeleton);
+  depth_player_free (player);
+}
+
+static gint
+compare_times (gconstpointer a, gconstpointer b)
+{
+  gint64 time_a = *(const gint64 *) a;
+  gint64 time_b = *(const gint64 *) b;
+
+  return time_a < time_b ? -1 : time_a > time_b;
+}
+
+/* Adds the job's line to the summary, in milliseconds */
+static void
+summarize_job (BatchJob *job, GString *summary)
+{
+  gint64 total = 0, p99 = 0, max = 0;
+  guint i, n_times;
+
+  n_times = job->frame_times != NULL ? job->frame_times->len : 0;
+  if (n_times > 0)
+    {
+      gint64 *times = (gint64 *) job->frame_times->data;
+
+      qsort (times, n_times, sizeof (gint64), compare_times);
+      for (i = 0; i < n_times; i++)
+        total += times[i];
+      p99 = times[MIN (n_times - 1, (n_times * 99 + 99) / 100 - 1)];
+      max = times[n_times - 1];
+    }
+
+  g_string_append_printf (summary, "%s\t%s\t%u\t%.1f\t%.1f\t%u",
+                          job->recording,
+                          job->params->name,
+                          job->n_frames,
+                          job->duration,
+                          job->n_frames > 0 ?
+                          100.0 * job->n_tracked / job->n_frames : 0.0,
+                          job->events != NULL ? job->events->len : 0);
+
+  if (job->has_expected)
+    g_string_append_printf (summary, "\t%.1f\t%.1f\t%.0f",
+                            job->n_expected > 0 ?
+                            100.0 * job->n_matched / job->n_expected : 100.0,
+                            job->n_produced > 0 ?
+                            100.0 * job->n_matched / job->n_produced : 100.0,
+                            job->n_matched > 0 ?
+                            job->total_delay / 1000.0 / job->n_matched : 0.0);
+  else
+    g_string_append (summary, "\t-\t-\t-");
+
+  g_string_append_printf (summary, "\t%.2f\t%.2f\t%.2f\t%s\n",
+                          n_times > 0 ? total / 1000.0 / n_times : 0.0,
+                          p99 / 1000.0,
+                          max / 1000.0,
+                          job->error_message != NULL ?
+                          job->error_message : "OK");
+}
+
+/* Runs what FILENAME describes. Sets that do not give the threshold
+   use THRESHOLD_BEGIN and THRESHOLD_END. Returns the exit status. */
+gint
+batch_run (const gchar *filename,
+           guint        threshold_begin,
+           guint        threshold_end)
+{
+  GKeyFile *file;
+  Batch batch;
+  GPtrArray *sets;
+  ParamSet defaults;
+  GestureState *gestures;
+  gchar **recordings, **groups, *dir, *templates, *screen;
+  BatchJob *jobs;
+  BatchWorker *workers;
+  gpointer *job_pointers, *worker_pointers;
+  gsize n_recordings;
+  guint i, j, n_jobs, n_workers, n_failed = 0;
+  gint64 start;
+  GString *summary;
+  GError *error = NULL;
+
+  file = g_key_file_new ();
+  if (! g_key_file_load_from_file (file, filename, G_KEY_FILE_NONE, &error))
+    {
+      g_printerr ("%s: %s\n", filename, error->message);
+      g_error_free (error);
+      g_key_file_free (file);
+      return 1;
+    }
+
+  recordings = g_key_file_get_string_list (file, BATCH_GROUP, "recordings",
+                                           &n_recordings, &error);
+  if (recordings == NULL)
+    {
+      g_printerr ("%s: %s\n", filename, error->message);
+      g_error_free (error);
+      g_key_file_free (file);
+      return 1;
+    }
+
+  /* Paths are relative to the batch file */
+  dir = g_path_get_dirname (filename);
+  for (i = 0; i < n_recordings; i++)
+    if (! g_path_is_absolute (recordings[i]))
+      {
+        gchar *path = g_build_filename (dir, recordings[i], NULL);
+
+        g_free (recordings[i]);
+        recordings[i] = path;
+      }
+
+  batch.output = g_key_file_get_string (file, BATCH_GROUP, "output", NULL);
+  if (batch.output == NULL)
+    batch.output = g_strdup (".");
+  batch.tolerance = DEFAULT_TOLERANCE;
+  if (g_key_file_has_key (file, BATCH_GROUP, "tolerance", NULL))
+    batch.tolerance = g_key_file_get_integer (file, BATCH_GROUP,
+                                              "tolerance", NULL);
+  batch.screen_width = 1920;
+  batch.screen_height = 1080;
+  screen = g_key_file_get_string (file, BATCH_GROUP, "screen", NULL);
+  if (screen != NULL &&
+      ! parse_screen (screen, &batch.screen_width, &batch.screen_height))
+    g_printerr ("Invalid screen size %s, using 1920x1080\n", screen);
+  g_free (screen);
+
+  /* The sets start from the gestures' and the demo's defaults */
+  gestures = gesture_state_new ();
+  memset (&defaults, 0, sizeof (ParamSet));
+  defaults.config = *gesture_state_get_config (gestures);
+  defaults.threshold_begin = threshold_begin;
+  defaults.threshold_end = threshold_end;
+  gesture_state_free (gestures);
+
+  sets = g_ptr_array_new_with_free_func ((GDestroyNotify) param_set_free);
+  groups = g_key_file_get_groups (file, NULL);
+  for (i = 0; groups[i] != NULL && error == NULL; i++)
+    if (g_strcmp0 (groups[i], BATCH_GROUP) != 0)
+      add_param_sets (file, groups[i], &defaults, sets, &error);
+  g_strfreev (groups);
+
+  if (error == NULL && sets->len == 0)
+    {
+      ParamSet *set = g_slice_new (ParamSet);
+
+      *set = defaults;
+      set->name = g_strdup ("default");
+      g_ptr_array_add (sets, set);
+    }
+
+  if (error == NULL && g_mkdir_with_parents (batch.output, 0755) != 0)
+    g_set_error (&error, G_FILE_ERROR, g_file_error_from_errno (errno),
+                 "Cannot create %s: %s", batch.output, g_strerror (errno));
+
+  if (error != NULL)
+    {
+      g_printerr ("%s: %s\n", filename, error->message);
+      g_error_free (error);
+      g_ptr_array_free (sets, TRUE);
+      g_strfreev (recordings);
+      g_free (batch.output);
+      g_free (dir);
+      g_key_file_free (file);
+      return 1;
+    }
+
+  n_jobs = n_recordings * sets->len;
+  jobs = g_new0 (BatchJob, n_jobs);
+  job_pointers = g_new (gpointer, n_jobs);
+  for (i = 0; i < n_recordings; i++)
+    for (j = 0; j < sets->len; j++)
+      {
+        BatchJob *job = &jobs[i * sets->len + j];
+
+        job->recording = recordings[i];
+        job->params = g_ptr_array_index (sets, j);
+        job_pointers[i * sets->len + j] = job;
+      }
+
+  n_workers = work_pool_get_n_cpus ();
+  if (g_key_file_has_key (file, BATCH_GROUP, "threads", NULL))
+    n_workers = MAX (1, g_key_file_get_integer (file, BATCH_GROUP,
+                                                "threads", NULL));
+  n_workers = MAX (1, MIN (n_workers, n_jobs));
+
+  templates = g_key_file_get_string (file, BATCH_GROUP, "templates", NULL);
+  if (templates != NULL && ! g_path_is_absolute (templates))
+    {
+      gchar *path = g_build_filename (dir, templates, NULL);
+
+      g_free (templates);
+      templates = path;
+    }
+
+  workers = g_new0 (BatchWorker, n_workers);
+  worker_pointers = g_new (gpointer, n_workers);
+  for (i = 0; i < n_workers; i++)
+    {
+      workers[i].gestures = gesture_state_new ();
+      gesture_state_capture_events (workers[i].gestures,
+                                    batch.screen_width,
+                                    batch.screen_height,
+                                    RESERVED_EVENTS);
+      workers[i].recognizer = dtw_recognizer_new ();
+      if (templates != NULL &&
+          ! dtw_recognizer_load (workers[i].recognizer, templates, &error))
+        {
+          g_printerr ("%s\n", error->message);
+          g_error_free (error);
+          error = NULL;
+          g_free (templates);
+          templates = NULL;
+        }
+      workers[i].pyramids = depth_pyramid_pool_new ();
+      worker_pointers[i] = &workers[i];
+    }
+
+  g_print ("Running %u recordings with %u parameter sets on %u threads\n",
+           (guint) n_recordings, sets->len, n_workers);
+  start = g_get_monotonic_time ();
+  work_pool_run (job_pointers, n_jobs, worker_pointers, n_workers,
+                 run_job, &batch);
+
+  summary = g_string_new ("recording\tparameters\tframes\tseconds\t"
+                          "tracked %\tevents\tfound %\tcorrect %\t"
+                          "delay ms\tframe ms\t99% ms\tmax ms\tstatus\n");
+  for (i = 0; i < n_jobs; i++)
+    {
+      summarize_job (&jobs[i], summary);
+      if (jobs[i].error_message != NULL)
+        n_failed++;
+    }
+  g_print ("%s", summary->str);
+  g_print ("Done in %.1f s\n", (g_get_monotonic_time () - start) / 1e6);
+
+  {
+    gchar *path = g_build_filename (batch.output, "summary.tsv", NULL);
+
+    if (! g_file_set_contents (path, summary->str, summary->len, &error))
+      {
+        g_printerr ("%s\n", error->message);
+        g_error_free (error);
+        n_failed++;
+      }
+    g_free (path);
+  }
+  g_string_free (summary, TRUE);
+
+  for (i = 0; i < n_workers; i++)
+    {
+      gesture_state_free (workers[i].gestures);
+      dtw_recognizer_free (workers[i].recognizer);
+      depth_pyramid_pool_free (workers[i].pyramids);
+    }
+  for (i = 0; i < n_jobs; i++)
+    {
+      g_free (jobs[i].error_message);
+      if (jobs[i].events != NULL)
+        g_array_free (jobs[i].events, TRUE);
+      if (jobs[i].frame_times != NULL)
+        g_array_free (jobs[i].frame_times, TRUE);
+    }
+  g_free (workers);
+  g_free (worker_pointers);
+  g_free (jobs);
+  g_free (job_pointers);
+  g_free (templates);
+  g_ptr_array_free (sets, TRUE);
+  g_strfreev (recordings);
+  g_free (batch.output);
+  g_free (dir);
+  g_key_file_free (file);
+
+  return n_failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,31 @@
+/* Skeltrack Desktop Control: Batch
+ *
+ * Copyright (c) 2012 Igalia, S.L.
+ *
+ * Author: Joaquim Rocha <jrocha@igalia.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef __BATCH_H__
+#define __BATCH_H__
+
+#include <glib.h>
+
+gint batch_run (const gchar *filename,
+                guint        threshold_begin,
+                guint        threshold_end);
+
+#endif /* __BATCH_H__ */
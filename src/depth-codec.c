@@ -0,0 +1,500 @@
+/* Skeltrack Desktop Control: Depth Codec
+ *
+ * Copyright (c) 2012 Igalia, S.L.
+ *
+ * Author: Joaquim Rocha <jrocha@igalia.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Lossless coding of 16 bit depth frames.
+
+   Every pixel is predicted: from the same pixel in the previous frame
+   (delta frames) or, in key frames, which need no previous frame so
+   recordings can be sought, from its left, upper and upper-left
+   neighbours with the median predictor of LOCO-I. The difference with the
+   prediction becomes a symbol:
+
+     0       the pixel is the predicted value
+     1       the pixel is 0, i.e. no reading or out of the sensor's range
+     2...    zigzag (pixel - prediction) + 1
+
+   Static background and areas without readings are long runs of 0, so
+   the frame is coded as pairs (number of 0 symbols, next symbol), both
+   with adaptive Golomb-Rice codes. Decoding a run of a delta frame is
+   a plain memcpy from the previous frame. */
+
+#include "depth-codec.h"
+
+#include <string.h>
+
+#define FRAME_TYPE_KEY   'I'
+#define FRAME_TYPE_DELTA 'P'
+
+/* Longest unary part of a Rice code, longer values are escaped
+   and written with 32 bits */
+#define RICE_LIMIT 24
+#define MAX_RICE_K 24
+
+/* Golomb-Rice parameter estimation as done in JPEG-LS */
+typedef struct
+{
+  guint32 sum;
+  guint32 count;
+} RiceContext;
+
+typedef struct
+{
+  guint8 *data;
+  gsize pos;
+  guint64 bits;
+  gint count;
+} BitWriter;
+
+typedef struct
+{
+  const guint8 *start;
+  const guint8 *data;
+  const guint8 *end;
+  gsize padding;
+  guint64 bits;
+  gint count;
+} BitReader;
+
+static inline void
+rice_context_init (RiceContext *context)
+{
+  context->sum = 4;
+  context->count = 1;
+}
+
+static inline gint
+rice_context_get_k (RiceContext *context)
+{
+  gint k;
+
+  /* The smallest k with count << k >= sum is either the difference of
+     their bit lengths or one more. Whether it is one more changes from
+     one symbol to the next in noisy areas, so this is written without
+     branches, which would often be mispredicted. */
+  k = __builtin_clz (context->count) - __builtin_clz (context->sum | 1);
+  k = MAX (k, 0);
+  k += (context->count << k) < context->sum;
+
+  return MIN (k, MAX_RICE_K);
+}
+
+static inline void
+rice_context_update (RiceContext *context, guint32 value)
+{
+  context->sum += value;
+  context->count++;
+  if (context->count == 64)
+    {
+      context->sum >>= 1;
+      context->count >>= 1;
+    }
+}
+
+static inline guint32
+zigzag (gint32 value)
+{
+  return ((guint32) value << 1) ^ (guint32) (value >> 31);
+}
+
+static inline gint32
+unzigzag (guint32 value)
+{
+  return (gint32) (value >> 1) ^ -(gint32) (value & 1);
+}
+
+static inline void
+bit_writer_put (BitWriter *writer, guint32 value, gint n)
+{
+  writer->bits = (writer->bits << n) | value;
+  writer->count += n;
+  while (writer->count >= 8)
+    {
+      writer->count -= 8;
+      writer->data[writer->pos++] = (guint8) (writer->bits >> writer->count);
+    }
+}
+
+static inline void
+bit_writer_flush (BitWriter *writer)
+{
+  if (writer->count > 0)
+    bit_writer_put (writer, 0, 8 - writer->count);
+}
+
+static inline void
+bit_writer_put_rice (BitWriter *writer, RiceContext *context, guint32 value)
+{
+  gint k;
+  guint32 q;
+
+  k = rice_context_get_k (context);
+  q = value >> k;
+
+  if (q < RICE_LIMIT)
+    {
+      bit_writer_put (writer, 1, q + 1);
+      if (k > 0)
+        bit_writer_put (writer, value & ((1 << k) - 1), k);
+    }
+  else
+    {
+      bit_writer_put (writer, 1, RICE_LIMIT + 1);
+      bit_writer_put (writer, value >> 16, 16);
+      bit_writer_put (writer, value & 0xffff, 16);
+    }
+
+  rice_context_update (context, value);
+}
+
+static inline __attribute__ ((always_inline)) void
+bit_reader_refill (BitReader *reader)
+{
+  if (G_LIKELY (reader->end - reader->data >= 8))
+    {
+      guint64 value;
+
+      memcpy (&value, reader->data, sizeof (value));
+      reader->bits |= GUINT64_FROM_BE (value) >> reader->count;
+      reader->data += (63 - reader->count) >> 3;
+      reader->count |= 56;
+      return;
+    }
+
+  while (reader->count <= 56)
+    {
+      guint64 byte = 0;
+
+      if (reader->data < reader->end)
+        byte = *reader->data++;
+      else
+        reader->padding++;
+
+      reader->bits |= byte << (56 - reader->count);
+      reader->count += 8;
+    }
+}
+
+static inline guint32
+bit_reader_get (BitReader *reader, gint n)
+{
+  guint32 value;
+
+  value = (guint32) (reader->bits >> (64 - n));
+  reader->bits <<= n;
+  reader->count -= n;
+
+  return value;
+}
+
+static inline __attribute__ ((always_inline)) gboolean
+bit_reader_get_rice (BitReader *reader, RiceContext *context, guint32 *value)
+{
+  gint k, q;
+
+  bit_reader_refill (reader);
+
+  if (G_UNLIKELY (reader->bits == 0))
+    return FALSE;
+
+  q = __builtin_clzll (reader->bits);
+  if (G_UNLIKELY (q > RICE_LIMIT))
+    return FALSE;
+
+  if (G_LIKELY (q < RICE_LIMIT))
+    {
+      guint64 rest;
+      gint length;
+
+      /* The unary part and the k low bits are taken in one go; the
+         low bits are shifted in two steps so that k can be 0 */
+      k = rice_context_get_k (context);
+      length = q + 1 + k;
+      rest = reader->bits << (q + 1);
+      *value = ((guint32) q << k) | (guint32) ((rest >> 32) >> (32 - k));
+      reader->bits <<= length;
+      reader->count -= length;
+    }
+  else
+    {
+      reader->bits <<= q + 1;
+      reader->count -= q + 1;
+      bit_reader_refill (reader);
+      *value = bit_reader_get (reader, 16) << 16;
+      *value |= bit_reader_get (reader, 16);
+    }
+
+  rice_context_update (context, *value);
+
+  return TRUE;
+}
+
+/* Prediction for key frames: the median edge detector of LOCO-I, which
+   picks the left or the upper pixel next to edges and follows the slope
+   of the surface elsewhere */
+static inline guint16
+key_prediction (const guint16 *frame, gsize pos, guint x, guint width)
+{
+  gint left, up, up_left;
+
+  if (pos < width)
+    return x > 0 ? frame[pos - 1] : 0;
+
+  up = frame[pos - width];
+  if (x == 0)
+    return up;
+
+  left = frame[pos - 1];
+  up_left = frame[pos - width - 1];
+
+  if (up_left >= MAX (left, up))
+    return MIN (left, up);
+  if (up_left <= MIN (left, up))
+    return MAX (left, up);
+  return left + up - up_left;
+}
+
+static inline gsize
+fill_key_run (guint16 *frame, gsize pos, gsize run, guint x, guint width)
+{
+  gsize end = pos + run;
+
+  for (; pos < end; pos++)
+    {
+      frame[pos] = key_prediction (frame, pos, x, width);
+      if (++x == width)
+        x = 0;
+    }
+
+  return pos;
+}
+
+gsize
+depth_codec_get_max_encoded_size (guint width, guint height)
+{
+  /* Worst case is every pixel being an escaped symbol after an
+     empty run: 1 + RICE_LIMIT + 1 + 32 bits, i.e. under 8 bytes */
+  return 1 + (gsize) width * height * 8 + 8;
+}
+
+/* Encodes frame into data, which must have room for
+   depth_codec_get_max_encoded_size bytes. With previous set to NULL the
+   frame is a key frame, which can be decoded on its own. Returns the
+   number of bytes written. */
+gsize
+depth_codec_encode (const guint16 *frame,
+                    const guint16 *previous,
+                    guint width,
+                    guint height,
+                    guint8 *data)
+{
+  BitWriter writer = { data, 0, 0, 0 };
+  RiceContext run_context, symbol_context;
+  guint x, y;
+  guint32 run = 0;
+
+  g_return_val_if_fail (frame != NULL && data != NULL, 0);
+
+  rice_context_init (&run_context);
+  rice_context_init (&symbol_context);
+
+  writer.data[writer.pos++] = previous ? FRAME_TYPE_DELTA : FRAME_TYPE_KEY;
+
+  for (y = 0; y < height; y++)
+    {
+      const guint16 *row = frame + (gsize) y * width;
+
+      for (x = 0; x < width; x++)
+        {
+          guint16 value, prediction;
+          guint32 symbol;
+
+          value = row[x];
+          if (previous != NULL)
+            prediction = previous[(gsize) y * width + x];
+          else
+            prediction = key_prediction (frame,
+                                         (gsize) y * width + x,
+                                         x,
+                                         width);
+
+          if (value == prediction)
+            {
+              run++;
+              continue;
+            }
+
+          if (value == 0)
+            symbol = 1;
+          else
+            symbol = zigzag ((gint32) value - prediction) + 1;
+
+          bit_writer_put_rice (&writer, &run_context, run);
+          bit_writer_put_rice (&writer, &symbol_context, symbol - 1);
+          run = 0;
+        }
+    }
+
+  /* The decoder stops when the frame is full, so
+     the last run is only needed if it is not empty */
+  if (run > 0)
+    bit_writer_put_rice (&writer, &run_context, run);
+
+  bit_writer_flush (&writer);
+
+  return writer.pos;
+}
+
+/* The pairs of a delta frame: runs are copied from the previous frame.
+   Kept apart from key frames, with the reader in local variables, so
+   that the loop stays in registers. */
+static gboolean
+decode_delta (BitReader     *state,
+              const guint16 *previous,
+              guint16       *frame,
+              gsize          n_pixels)
+{
+  BitReader reader = *state;
+  RiceContext run_context, symbol_context;
+  gsize pos = 0;
+
+  rice_context_init (&run_context);
+  rice_context_init (&symbol_context);
+
+  while (pos < n_pixels)
+    {
+      guint32 run, symbol;
+
+      if (! bit_reader_get_rice (&reader, &run_context, &run) ||
+          run > n_pixels - pos)
+        return FALSE;
+
+      if (run < 16 && pos + 16 <= n_pixels)
+        {
+          /* Most runs between noisy pixels are short: copying a fixed
+             16 pixels avoids a loop whose length cannot be predicted,
+             the ones after the run are written again later */
+          memcpy (frame + pos, previous + pos, 16 * sizeof (guint16));
+        }
+      else
+        {
+          memcpy (frame + pos, previous + pos, run * sizeof (guint16));
+        }
+      pos += run;
+
+      if (pos == n_pixels)
+        break;
+
+      if (! bit_reader_get_rice (&reader, &symbol_context, &symbol))
+        return FALSE;
+
+      frame[pos] = symbol == 0 ? 0 : (guint16) (previous[pos] +
+                                                unzigzag (symbol));
+      pos++;
+    }
+
+  *state = reader;
+
+  return TRUE;
+}
+
+static gboolean
+decode_key (BitReader *state,
+            guint16   *frame,
+            guint      width,
+            gsize      n_pixels)
+{
+  BitReader reader = *state;
+  RiceContext run_context, symbol_context;
+  gsize pos = 0;
+
+  rice_context_init (&run_context);
+  rice_context_init (&symbol_context);
+
+  while (pos < n_pixels)
+    {
+      guint32 run, symbol;
+      guint16 prediction;
+
+      if (! bit_reader_get_rice (&reader, &run_context, &run) ||
+          run > n_pixels - pos)
+        return FALSE;
+
+      pos = fill_key_run (frame, pos, run, pos % width, width);
+
+      if (pos == n_pixels)
+        break;
+
+      if (! bit_reader_get_rice (&reader, &symbol_context, &symbol))
+        return FALSE;
+
+      prediction = key_prediction (frame, pos, pos % width, width);
+      frame[pos] = symbol == 0 ? 0 : (guint16) (prediction +
+                                                unzigzag (symbol));
+      pos++;
+    }
+
+  *state = reader;
+
+  return TRUE;
+}
+
+/* Decodes data into frame. previous must be the frame decoded before
+   this one if data is a delta frame and is ignored for key frames.
+   Returns FALSE if data is not a valid frame of the given size. */
+gboolean
+depth_codec_decode (const guint8 *data,
+                    gsize size,
+                    const guint16 *previous,
+                    guint width,
+                    guint height,
+                    guint16 *frame)
+{
+  BitReader reader;
+  gsize n_pixels;
+  gboolean key, decoded;
+
+  g_return_val_if_fail (data != NULL && frame != NULL, FALSE);
+
+  if (size < 1)
+    return FALSE;
+
+  key = data[0] == FRAME_TYPE_KEY;
+  if (! key && (data[0] != FRAME_TYPE_DELTA || previous == NULL))
+    return FALSE;
+
+  reader.start = data + 1;
+  reader.data = reader.start;
+  reader.end = data + size;
+  reader.padding = 0;
+  reader.bits = 0;
+  reader.count = 0;
+
+  n_pixels = (gsize) width * height;
+  if (key)
+    decoded = decode_key (&reader, frame, width, n_pixels);
+  else
+    decoded = decode_delta (&reader, previous, frame, n_pixels);
+  if (! decoded)
+    return FALSE;
+
+  /* Every bit read must have been in data and not in the padding */
+  return (reader.data - reader.start + reader.padding) * 8 - reader.count <=
+    (gsize) (reader.end - reader.start) * 8;
+}
@@ -0,0 +1,42 @@
+/* Skeltrack Desktop Control: Depth Codec
+ *
+ * Copyright (c) 2012 Igalia, S.L.
+ *
+ * Author: Joaquim Rocha <jrocha@igalia.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __DEPTH_CODEC_H__
+#define __DEPTH_CODEC_H__
+
+#include <glib.h>
+
+gsize    depth_codec_get_max_encoded_size (guint width,
+                                           guint height);
+
+gsize    depth_codec_encode               (const guint16 *frame,
+                                           const guint16 *previous,
+                                           guint          width,
+                                           guint          height,
+                                           guint8        *data);
+
+gboolean depth_codec_decode               (const guint8  *data,
+                                           gsize          size,
+                                           const guint16 *previous,
+                                           guint          width,
+                                           guint          height,
+                                           guint16       *frame);
+
+#endif /* __DEPTH_CODEC_H__ */
@@ -0,0 +1,331 @@
+/* Skeltrack Desktop Control: Depth Pyramid
+ *
+ * Copyright (c) 2012 Igalia, S.L.
+ *
+ * Author: Joaquim Rocha <jrocha@igalia.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/* The depth frame at the resolutions its users want, with the pixels
+   outside the threshold set to 0: full size for the hands, Skeltrack's
+   dimension reduction for the tracking and the coarsest for the preview.
+
+   Each pixel of a level is the frame's pixel at its top left corner,
+   like the reduction Skeltrack was given before, so the levels are
+   built in a single pass over the frame: each row is thresholded into
+   the first level and, while it is still in the cache, sampled into the
+   coarser levels it belongs to and into a coarse histogram of the depth,
+   used to choose the threshold of the next frames.
+
+   A pyramid stays in use until Skeltrack is done with it, so they are
+   taken from a pool and given back to it, and a frame does not
+   allocate once the pool holds as many as are in flight. */
+
+#include "depth-pyramid.h"
+
+#include <string.h>
+
+struct _DepthPyramid
+{
+  DepthPyramidPool *pool;
+  guint width;
+  guint height;
+  guint extra_factor;
+  DepthLevel levels[DEPTH_PYRAMID_MAX_LEVELS];
+  guint n_levels;
+  /* Levels that are powers of two, which come first */
+  guint n_powers;
+  guint histogram[DEPTH_PYRAMID_HISTOGRAM_BINS];
+  guint16 *data;
+
+  /* Next unused pyramid in the pool */
+  DepthPyramid *next;
+};
+
+struct _DepthPyramidPool
+{
+  DepthPyramid *free_pyramids;
+  guint n_used;
+  /* Freed once the pyramids in use are given back */
+  gboolean closed;
+};
+
+static DepthPyramid *
+depth_pyramid_new (DepthPyramidPool *pool,
+                   guint width,
+                   guint height,
+                   guint extra_factor)
+{
+  DepthPyramid *pyramid;
+  guint factor, i, size;
+
+  pyramid = g_slice_new0 (DepthPyramid);
+  pyramid->pool = pool;
+  pyramid->width = width;
+  pyramid->height = height;
+  pyramid->extra_factor = extra_factor;
+
+  for (factor = 1; factor <= DEPTH_PYRAMID_COARSEST; factor *= 2)
+    pyramid->levels[pyramid->n_levels++].factor = factor;
+  pyramid->n_powers = pyramid->n_levels;
+  if (extra_factor > 0 &&
+      depth_pyramid_get_level (pyramid, extra_factor) == NULL)
+    pyramid->levels[pyramid->n_levels++].factor = extra_factor;
+
+  size = 0;
+  for (i = 0; i < pyramid->n_levels; i++)
+    {
+      DepthLevel *level = &pyramid->levels[i];
+
+      level->width = width / level->factor;
+      level->height = height / level->factor;
+      size += level->width * level->height;
+    }
+
+  pyramid->data = g_new (guint16, size);
+  size = 0;
+  for (i = 0; i < pyramid->n_levels; i++)
+    {
+      DepthLevel *level = &pyramid->levels[i];
+
+      level->data = pyramid->data + size;
+      size += level->width * level->height;
+    }
+
+  return pyramid;
+}
+
+static void
+depth_pyramid_free (DepthPyramid *pyramid)
+{
+  g_free (pyramid->data);
+  g_slice_free (DepthPyramid, pyramid);
+}
+
+DepthPyramidPool *
+depth_pyramid_pool_new (void)
+{
+  return g_slice_new0 (DepthPyramidPool);
+}
+
+void
+depth_pyramid_pool_free (DepthPyramidPool *pool)
+{
+  g_return_if_fail (pool != NULL);
+
+  while (pool->free_pyramids != NULL)
+    {
+      DepthPyramid *pyramid = pool->free_pyramids;
+
+      pool->free_pyramids = pyramid->next;
+      depth_pyramid_free (pyramid);
+    }
+
+  if (pool->n_used > 0)
+    pool->closed = TRUE;
+  else
+    g_slice_free (DepthPyramidPool, pool);
+}
+
+/* A pyramid for frames of WIDTH x HEIGHT that also has a level for
+   EXTRA_FACTOR, unless it is 0. To be given back to the pool with
+   depth_pyramid_release(). */
+DepthPyramid *
+depth_pyramid_pool_get (DepthPyramidPool *pool,
+                        guint             width,
+                        guint             height,
+                        guint             extra_factor)
+{
+  DepthPyramid *pyramid = NULL;
+
+  g_return_val_if_fail (pool != NULL && ! pool->closed, NULL);
+  g_return_val_if_fail (width >= DEPTH_PYRAMID_COARSEST &&
+                        height >= DEPTH_PYRAMID_COARSEST, NULL);
+
+  while (pool->free_pyramids != NULL && pyramid == NULL)
+    {
+      pyramid = pool->free_pyramids;
+      pool->free_pyramids = pyramid->next;
+
+      /* Made for another size, which will not come back */
+      if (pyramid->width != width ||
+          pyramid->height != height ||
+          pyramid->extra_factor != extra_factor)
+        {
+          depth_pyramid_free (pyramid);
+          pyramid = NULL;
+        }
+    }
+
+  if (pyramid == NULL)
+    pyramid = depth_pyramid_new (pool, width, height, extra_factor);
+  pool->n_used++;
+
+  return pyramid;
+}
+
+void
+depth_pyramid_release (DepthPyramid *pyramid)
+{
+  DepthPyramidPool *pool;
+
+  g_return_if_fail (pyramid != NULL);
+
+  pool = pyramid->pool;
+  pool->n_used--;
+  if (pool->closed)
+    {
+      depth_pyramid_free (pyramid);
+      if (pool->n_used == 0)
+        g_slice_free (DepthPyramidPool, pool);
+      return;
+    }
+
+  pyramid->next = pool->free_pyramids;
+  pool->free_pyramids = pyramid;
+}
+
+static void
+threshold_row (guint16       * restrict dest,
+               const guint16 * restrict src,
+               guint                    n_pixels,
+               guint16                  begin,
+               guint16                  end)
+{
+  guint i;
+
+  for (i = 0; i < n_pixels; i++)
+    dest[i] = src[i] >= begin && src[i] <= end ? src[i] : 0;
+}
+
+static void
+halve_row (guint16       * restrict dest,
+           const guint16 * restrict src,
+           guint                    n_pixels)
+{
+  guint i;
+
+  for (i = 0; i < n_pixels; i++)
+    dest[i] = src[i * 2];
+}
+
+static void
+add_to_histogram (guint *histogram, const guint16 *src, guint n_pixels)
+{
+  guint i;
+
+  for (i = 0; i < n_pixels; i += DEPTH_PYRAMID_HISTOGRAM_STEP)
+    {
+      guint bin = src[i] / DEPTH_PYRAMID_HISTOGRAM_BIN_SIZE;
+
+      /* 0 is where the sensor could not tell */
+      if (src[i] != 0)
+        histogram[MIN (bin, DEPTH_PYRAMID_HISTOGRAM_BINS - 1)]++;
+    }
+}
+
+/* Fills every level from DEPTH, which has the size the pyramid was
+   made for */
+void
+depth_pyramid_build (DepthPyramid  *pyramid,
+                     const guint16 *depth,
+                     guint          threshold_begin,
+                     guint          threshold_end)
+{
+  guint i, j, l, width;
+  guint16 begin, end;
+
+  g_return_if_fail (pyramid != NULL && depth != NULL);
+
+  /* Compared as they are stored, so the loop is vectorized */
+  begin = MIN (threshold_begin, G_MAXUINT16);
+  end = MIN (threshold_end, G_MAXUINT16);
+
+  memset (pyramid->histogram, 0, sizeof (pyramid->histogram));
+
+  width = pyramid->levels[0].width;
+  for (j = 0; j < pyramid->levels[0].height; j++)
+    {
+      const guint16 *src = depth + j * pyramid->width;
+      guint16 *row = pyramid->levels[0].data + j * width;
+
+      threshold_row (row, src, width, begin, end);
+
+      if (j % DEPTH_PYRAMID_HISTOGRAM_STEP == 0)
+        add_to_histogram (pyramid->histogram, src, width);
+
+      /* Each power of two takes one in two pixels of the row just
+         written to the level before it */
+      for (l = 1; l < pyramid->n_powers; l++)
+        {
+          const DepthLevel *level = &pyramid->levels[l];
+          const DepthLevel *finer = &pyramid->levels[l - 1];
+
+          if (j % level->factor != 0 || j / level->factor >= level->height)
+            break;
+
+          halve_row (level->data + (j / level->factor) * level->width,
+                     finer->data + (j / finer->factor) * finer->width,
+                     level->width);
+        }
+
+      if (pyramid->n_levels > pyramid->n_powers)
+        {
+          const DepthLevel *level = &pyramid->levels[pyramid->n_powers];
+          guint factor = level->factor;
+          guint16 *dest;
+
+          if (j % factor != 0 || j / factor >= level->height)
+            continue;
+
+          dest = level->data + (j / factor) * level->width;
+          for (i = 0; i < level->width; i++)
+            dest[i] = row[i * factor];
+        }
+    }
+}
+
+/* The level where a pixel is FACTOR pixels of the frame, if it has one */
+const DepthLevel *
+depth_pyramid_get_level (DepthPyramid *pyramid, guint factor)
+{
+  guint i;
+
+  g_return_val_if_fail (pyramid != NULL, NULL);
+
+  for (i = 0; i < pyramid->n_levels; i++)
+    if (pyramid->levels[i].factor == factor)
+      return &pyramid->levels[i];
+
+  return NULL;
+}
+
+const DepthLevel *
+depth_pyramid_get_coarsest (DepthPyramid *pyramid)
+{
+  g_return_val_if_fail (pyramid != NULL, NULL);
+
+  return depth_pyramid_get_level (pyramid, DEPTH_PYRAMID_COARSEST);
+}
+
+/* DEPTH_PYRAMID_HISTOGRAM_BINS counts of the last frame built */
+const guint *
+depth_pyramid_get_histogram (DepthPyramid *pyramid)
+{
+  g_return_val_if_fail (pyramid != NULL, NULL);
+
+  return pyramid->histogram;
+}
@@ -0,0 +1,74 @@
+/* Skeltrack Desktop Control: Depth Pyramid
+ *
+ * Copyright (c) 2012 Igalia, S.L.
+ *
+ * Author: Joaquim Rocha <jrocha@igalia.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef __DEPTH_PYRAMID_H__
+#define __DEPTH_PYRAMID_H__
+
+#include <glib.h>
+
+/* Levels always built, one every power of two up to the coarsest,
+   plus one for Skeltrack's dimension reduction if it is not one */
+#define DEPTH_PYRAMID_COARSEST 8
+#define DEPTH_PYRAMID_MAX_LEVELS 5
+
+/* Histogram of the depth before thresholding, made from one in
+   DEPTH_PYRAMID_HISTOGRAM_STEP pixels in each direction. The last bin
+   also has everything further away. */
+#define DEPTH_PYRAMID_HISTOGRAM_BINS 80
+#define DEPTH_PYRAMID_HISTOGRAM_BIN_SIZE 100
+#define DEPTH_PYRAMID_HISTOGRAM_STEP 4
+
+typedef struct
+{
+  guint16 *data;
+  guint width;
+  guint height;
+  /* One pixel of the level is FACTOR pixels of the frame */
+  guint factor;
+} DepthLevel;
+
+typedef struct _DepthPyramid DepthPyramid;
+typedef struct _DepthPyramidPool DepthPyramidPool;
+
+DepthPyramidPool * depth_pyramid_pool_new       (void);
+
+void               depth_pyramid_pool_free      (DepthPyramidPool *pool);
+
+DepthPyramid *     depth_pyramid_pool_get       (DepthPyramidPool *pool,
+                                                 guint             width,
+                                                 guint             height,
+                                                 guint             extra_factor);
+
+void               depth_pyramid_release        (DepthPyramid *pyramid);
+
+void               depth_pyramid_build          (DepthPyramid  *pyramid,
+                                                 const guint16 *depth,
+                                                 guint          threshold_begin,
+                                                 guint          threshold_end);
+
+const DepthLevel * depth_pyramid_get_level      (DepthPyramid *pyramid,
+                                                 guint         factor);
+
+const DepthLevel * depth_pyramid_get_coarsest   (DepthPyramid *pyramid);
+
+const guint *      depth_pyramid_get_histogram  (DepthPyramid *pyramid);
+
+#endif /* __DEPTH_PYRAMID_H__ */
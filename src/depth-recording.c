@@ -0,0 +1,504 @@
+/* Skeltrack Desktop Control: Depth Recording
+ *
+ * Copyright (c) 2012 Igalia, S.L.
+ *
+ * Author: Joaquim Rocha <jrocha@igalia.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Recordings are a header, the frames coded with depth-codec one after the
+   other and, once the recording is closed, an index of the frames followed
+   by a footer pointing to it. A key frame is stored every
+   KEY_FRAME_INTERVAL frames so that any frame can be decoded starting from
+   the key frame before it. Recordings that were not closed (e.g. the
+   program crashed) have no index; it is rebuilt by walking the frames.
+
+   All numbers are little endian. */
+
+#include "depth-recording.h"
+#include "depth-codec.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#define RECORDING_MAGIC     "SKDR"
+#define RECORDING_END_MAGIC "SKDE"
+#define RECORDING_VERSION   1
+
+/* One second of the Kinect's depth stream */
+#define KEY_FRAME_INTERVAL 30
+
+#define FRAME_FLAG_KEY (1 << 0)
+
+/* Larger frames are taken to be a corrupt header */
+#define MAX_DIMENSION 4096
+
+typedef struct
+{
+  gchar magic[4];
+  guint32 version;
+  guint32 width;
+  guint32 height;
+  guint32 key_frame_interval;
+  guint32 reserved[3];
+} RecordingHeader;
+
+typedef struct
+{
+  guint32 size;
+  guint32 flags;
+  gint64 timestamp;
+} FrameHeader;
+
+typedef struct
+{
+  guint64 offset;
+  gint64 timestamp;
+  guint32 size;
+  guint32 flags;
+} IndexEntry;
+
+typedef struct
+{
+  guint64 index_offset;
+  guint32 n_frames;
+  gchar magic[4];
+} RecordingFooter;
+
+struct _DepthRecorder
+{
+  FILE *file;
+  gchar *filename;
+  guint width;
+  guint height;
+  guint64 offset;
+  GArray *index;
+  guint16 *previous;
+  guint8 *encoded;
+};
+
+struct _DepthPlayer
+{
+  GMappedFile *file;
+  const guint8 *data;
+  gsize size;
+  guint width;
+  guint height;
+  GArray *index;
+  guint16 *current;
+  guint16 *scratch;
+  gint current_index;
+};
+
+static gboolean
+write_data (DepthRecorder *recorder,
+            gconstpointer data,
+            gsize size,
+            GError **error)
+{
+  if (fwrite (data, 1, size, recorder->file) != size)
+    {
+      g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+                   "Failed to write to %s: %s",
+                   recorder->filename, g_strerror (errno));
+      return FALSE;
+    }
+  recorder->offset += size;
+
+  return TRUE;
+}
+
+DepthRecorder *
+depth_recorder_new (const gchar *filename,
+                    guint width,
+                    guint height,
+                    GError **error)
+{
+  DepthRecorder *recorder;
+  RecordingHeader header;
+
+  g_return_val_if_fail (filename != NULL, NULL);
+  g_return_val_if_fail (width > 0 && height > 0, NULL);
+
+  recorder = g_slice_new0 (DepthRecorder);
+  recorder->filename = g_strdup (filename);
+  recorder->width = width;
+  recorder->height = height;
+  recorder->index = g_array_new (FALSE, FALSE, sizeof (IndexEntry));
+  recorder->previous = g_new (guint16, width * height);
+  recorder->encoded = g_malloc (depth_codec_get_max_encoded_size (width,
+                                                                  height));
+
+  recorder->file = fopen (filename, "wb");
+  if (recorder->file == NULL)
+    {
+      g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+                   "Failed to create %s: %s", filename, g_strerror (errno));
+      depth_recorder_close (recorder, NULL);
+      return NULL;
+    }
+
+  memset (&header, 0, sizeof (header));
+  memcpy (header.magic, RECORDING_MAGIC, sizeof (header.magic));
+  header.version = GUINT32_TO_LE (RECORDING_VERSION);
+  header.width = GUINT32_TO_LE (width);
+  header.height = GUINT32_TO_LE (height);
+  header.key_frame_interval = GUINT32_TO_LE (KEY_FRAME_INTERVAL);
+
+  if (! write_data (recorder, &header, sizeof (header), error))
+    {
+      depth_recorder_close (recorder, NULL);
+      return NULL;
+    }
+
+  return recorder;
+}
+
+gboolean
+depth_recorder_add_frame (DepthRecorder *recorder,
+                          const guint16 *frame,
+                          gint64 timestamp,
+                          GError **error)
+{
+  FrameHeader frame_header;
+  IndexEntry entry;
+  gboolean key;
+  gsize size;
+
+  g_return_val_if_fail (recorder != NULL && frame != NULL, FALSE);
+
+  key = recorder->index->len % KEY_FRAME_INTERVAL == 0;
+  size = depth_codec_encode (frame,
+                             key ? NULL : recorder->previous,
+                             recorder->width,
+                             recorder->height,
+                             recorder->encoded);
+
+  entry.offset = recorder->offset;
+  entry.timestamp = timestamp;
+  entry.size = size;
+  entry.flags = key ? FRAME_FLAG_KEY : 0;
+
+  frame_header.size = GUINT32_TO_LE (entry.size);
+  frame_header.flags = GUINT32_TO_LE (entry.flags);
+  frame_header.timestamp = GINT64_TO_LE (timestamp);
+
+  if (! write_data (recorder, &frame_header, sizeof (frame_header), error) ||
+      ! write_data (recorder, recorder->encoded, size, error))
+    return FALSE;
+
+  g_array_append_val (recorder->index, entry);
+  memcpy (recorder->previous,
+          frame,
+          recorder->width * recorder->height * sizeof (guint16));
+
+  return TRUE;
+}
+
+/* Writes the index and frees the recorder, even if writing fails */
+gboolean
+depth_recorder_close (DepthRecorder *recorder, GError **error)
+{
+  gboolean success = TRUE;
+
+  g_return_val_if_fail (recorder != NULL, FALSE);
+
+  if (recorder->file != NULL)
+    {
+      RecordingFooter footer;
+      guint i;
+
+      footer.index_offset = GUINT64_TO_LE (recorder->offset);
+      footer.n_frames = GUINT32_TO_LE (recorder->index->len);
+      memcpy (footer.magic, RECORDING_END_MAGIC, sizeof (footer.magic));
+
+      for (i = 0; success && i < recorder->index->len; i++)
+        {
+          IndexEntry entry = g_array_index (recorder->index, IndexEntry, i);
+
+          entry.offset = GUINT64_TO_LE (entry.offset);
+          entry.timestamp = GINT64_TO_LE (entry.timestamp);
+          entry.size = GUINT32_TO_LE (entry.size);
+          entry.flags = GUINT32_TO_LE (entry.flags);
+          success = write_data (recorder, &entry, sizeof (entry), error);
+        }
+
+      if (success)
+        success = write_data (recorder, &footer, sizeof (footer), error);
+
+      if (fclose (recorder->file) != 0 && success)
+        {
+          g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+                       "Failed to write to %s: %s",
+                       recorder->filename, g_strerror (errno));
+          success = FALSE;
+        }
+    }
+
+  g_array_free (recorder->index, TRUE);
+  g_free (recorder->previous);
+  g_free (recorder->encoded);
+  g_free (recorder->filename);
+  g_slice_free (DepthRecorder, recorder);
+
+  return success;
+}
+
+static gboolean
+read_index (DepthPlayer *player)
+{
+  RecordingFooter footer;
+  guint64 index_offset;
+  guint i, n_frames;
+
+  if (player->size < sizeof (RecordingHeader) + sizeof (footer))
+    return FALSE;
+
+  memcpy (&footer, player->data + player->size - sizeof (footer),
+          sizeof (footer));
+  if (memcmp (footer.magic, RECORDING_END_MAGIC, sizeof (footer.magic)) != 0)
+    return FALSE;
+
+  index_offset = GUINT64_FROM_LE (footer.index_offset);
+  n_frames = GUINT32_FROM_LE (footer.n_frames);
+  if (index_offset < sizeof (RecordingHeader) ||
+      index_offset + (guint64) n_frames * sizeof (IndexEntry) +
+      sizeof (footer) != player->size)
+    return FALSE;
+
+  for (i = 0; i < n_frames; i++)
+    {
+      IndexEntry entry;
+
+      memcpy (&entry,
+              player->data + index_offset + i * sizeof (IndexEntry),
+              sizeof (entry));
+      entry.offset = GUINT64_FROM_LE (entry.offset);
+      entry.timestamp = GINT64_FROM_LE (entry.timestamp);
+      entry.size = GUINT32_FROM_LE (entry.size);
+      entry.flags = GUINT32_FROM_LE (entry.flags);
+
+      /* The frame must lie between the header and the index */
+      if (entry.offset < sizeof (RecordingHeader) ||
+          entry.offset > index_offset ||
+          index_offset - entry.offset < sizeof (FrameHeader) ||
+          entry.size > index_offset - entry.offset - sizeof (FrameHeader))
+        {
+          g_array_set_size (player->index, 0);
+          return FALSE;
+        }
+
+      g_array_append_val (player->index, entry);
+    }
+
+  return TRUE;
+}
+
+/* For recordings that were not closed */
+static void
+rebuild_index (DepthPlayer *player)
+{
+  guint64 offset = sizeof (RecordingHeader);
+
+  while (offset + sizeof (FrameHeader) <= player->size)
+    {
+      FrameHeader frame_header;
+      IndexEntry entry;
+
+      memcpy (&frame_header, player->data + offset, sizeof (frame_header));
+      entry.offset = offset;
+      entry.size = GUINT32_FROM_LE (frame_header.size);
+      entry.flags = GUINT32_FROM_LE (frame_header.flags);
+      entry.timestamp = GINT64_FROM_LE (frame_header.timestamp);
+
+      offset += sizeof (FrameHeader) + entry.size;
+      if (offset > player->size)
+        break;
+
+      g_array_append_val (player->index, entry);
+    }
+}
+
+DepthPlayer *
+depth_player_new (const gchar *filename, GError **error)
+{
+  DepthPlayer *player;
+  RecordingHeader header;
+  GMappedFile *file;
+
+  g_return_val_if_fail (filename != NULL, NULL);
+
+  file = g_mapped_file_new (filename, FALSE, error);
+  if (file == NULL)
+    return NULL;
+
+  player = g_slice_new0 (DepthPlayer);
+  player->file = file;
+  player->data = (const guint8 *) g_mapped_file_get_contents (file);
+  player->size = g_mapped_file_get_length (file);
+  player->index = g_array_new (FALSE, FALSE, sizeof (IndexEntry));
+  player->current_index = -1;
+
+  if (player->size >= sizeof (header))
+    memcpy (&header, player->data, sizeof (header));
+
+  if (player->size < sizeof (header) ||
+      memcmp (header.magic, RECORDING_MAGIC, sizeof (header.magic)) != 0 ||
+      GUINT32_FROM_LE (header.version) != RECORDING_VERSION)
+    {
+      g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+                   "%s is not a depth recording", filename);
+      depth_player_free (player);
+      return NULL;
+    }
+
+  player->width = GUINT32_FROM_LE (header.width);
+  player->height = GUINT32_FROM_LE (header.height);
+  if (player->width == 0 || player->width > MAX_DIMENSION ||
+      player->height == 0 || player->height > MAX_DIMENSION)
+    {
+      g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+                   "%s has invalid frames of %ux%u", filename,
+                   player->width, player->height);
+      depth_player_free (player);
+      return NULL;
+    }
+
+  player->current = g_new (guint16, player->width * player->height);
+  player->scratch = g_new (guint16, player->width * player->height);
+
+  if (! read_index (player))
+    {
+      g_debug ("%s has no index, it was probably not closed", filename);
+      rebuild_index (player);
+    }
+
+  if (player->index->len == 0)
+    {
+      g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+                   "%s has no frames", filename);
+      depth_player_free (player);
+      return NULL;
+    }
+
+  return player;
+}
+
+void
+depth_player_free (DepthPlayer *player)
+{
+  if (player == NULL)
+    return;
+
+  g_mapped_file_unref (player->file);
+  g_array_free (player->index, TRUE);
+  g_free (player->current);
+  g_free (player->scratch);
+  g_slice_free (DepthPlayer, player);
+}
+
+guint
+depth_player_get_n_frames (DepthPlayer *player)
+{
+  g_return_val_if_fail (player != NULL, 0);
+
+  return player->index->len;
+}
+
+void
+depth_player_get_size (DepthPlayer *player, guint *width, guint *height)
+{
+  g_return_if_fail (player != NULL);
+
+  *width = player->width;
+  *height = player->height;
+}
+
+gint64
+depth_player_get_timestamp (DepthPlayer *player, guint index)
+{
+  g_return_val_if_fail (player != NULL, 0);
+  g_return_val_if_fail (index < player->index->len, 0);
+
+  return g_array_index (player->index, IndexEntry, index).timestamp;
+}
+
+static gboolean
+decode_frame (DepthPlayer *player, guint index, GError **error)
+{
+  IndexEntry *entry;
+  guint16 *frame;
+  gboolean key;
+
+  entry = &g_array_index (player->index, IndexEntry, index);
+  key = (entry->flags & FRAME_FLAG_KEY) != 0;
+
+  if (! depth_codec_decode (player->data + entry->offset + sizeof (FrameHeader),
+                            entry->size,
+                            key ? NULL : player->current,
+                            player->width,
+                            player->height,
+                            player->scratch))
+    {
+      g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+                   "Frame %u of the recording is corrupt", index);
+      player->current_index = -1;
+      return FALSE;
+    }
+
+  frame = player->current;
+  player->current = player->scratch;
+  player->scratch = frame;
+  player->current_index = index;
+
+  return TRUE;
+}
+
+/* Returns the frame at index, which stays valid until the next call.
+   Reading the frames in order only decodes each of them once; seeking
+   decodes from the closest key frame before index. */
+const guint16 *
+depth_player_get_frame (DepthPlayer *player, guint index, GError **error)
+{
+  guint i, start;
+
+  g_return_val_if_fail (player != NULL, NULL);
+  g_return_val_if_fail (index < player->index->len, NULL);
+
+  if ((gint) index == player->current_index)
+    return player->current;
+
+  if (player->current_index >= 0 && (gint) index > player->current_index)
+    start = player->current_index + 1;
+  else
+    start = 0;
+
+  /* Only start from a later key frame if there is one */
+  for (i = index; i > start; i--)
+    {
+      if (g_array_index (player->index, IndexEntry, i).flags & FRAME_FLAG_KEY)
+        break;
+    }
+  start = i;
+
+  for (i = start; i <= index; i++)
+    {
+      if (! decode_frame (player, i, error))
+        return NULL;
+    }
+
+  return player->current;
+}
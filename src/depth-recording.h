@@ -0,0 +1,60 @@
+/* Skeltrack Desktop Control: Depth Recording
+ *
+ * Copyright (c) 2012 Igalia, S.L.
+ *
+ * Author: Joaquim Rocha <jrocha@igalia.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __DEPTH_RECORDING_H__
+#define __DEPTH_RECORDING_H__
+
+#include <glib.h>
+
+typedef struct _DepthRecorder DepthRecorder;
+typedef struct _DepthPlayer DepthPlayer;
+
+DepthRecorder * depth_recorder_new          (const gchar *filename,
+                                             guint        width,
+                                             guint        height,
+                                             GError     **error);
+
+gboolean        depth_recorder_add_frame    (DepthRecorder *recorder,
+                                             const guint16 *frame,
+                                             gint64         timestamp,
+                                             GError       **error);
+
+gboolean        depth_recorder_close        (DepthRecorder *recorder,
+                                             GError       **error);
+
+DepthPlayer *   depth_player_new            (const gchar *filename,
+                                             GError     **error);
+
+void            depth_player_free           (DepthPlayer *player);
+
+guint           depth_player_get_n_frames   (DepthPlayer *player);
+
+void            depth_player_get_size       (DepthPlayer *player,
+                                             guint       *width,
+                                             guint       *height);
+
+gint64          depth_player_get_timestamp  (DepthPlayer *player,
+                                             guint        index);
+
+const guint16 * depth_player_get_frame      (DepthPlayer *player,
+                                             guint        index,
+                                             GError     **error);
+
+#endif /* __DEPTH_RECORDING_H__ */
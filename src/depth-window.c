@@ -0,0 +1,195 @@
+/* Skeltrack Desktop Control: Depth Window
+ *
+ * Copyright (c) 2012 Igalia, S.L.
+ *
+ * Author: Joaquim Rocha <jrocha@igalia.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/* Chooses the range of depths given to Skeltrack from a histogram of
+   the frame's depth, so that it covers the user and as little else as
+   possible: the nearest depth where enough of the frame is, which is
+   taken to be the user's body, with room in front for the hands and a
+   little behind for the body itself.
+
+   While the user's head is tracked, the body is the depth nearest the
+   head's, so that something closer or the user leaning forward does not
+   pull the window away. Otherwise the nearest body is searched for, which
+   is how someone out of the window is found; with nobody there it is the
+   wall or the furniture, so the window then waits longer before moving.
+
+   The window only moves when the body is somewhere else by more than
+   HYSTERESIS, for SETTLE_FRAMES frames in a row (SEARCH_SETTLE_FRAMES
+   while searching), so it does not follow the noise or someone walking
+   by. */
+
+#include "depth-window.h"
+
+/* In millimeters */
+#define MIN_DEPTH 500
+#define REACH 700
+#define BODY_BACK 400
+#define HYSTERESIS 200
+
+/* Fraction of the frame's valid pixels that makes a body */
+#define MIN_BODY_FRACTION 0.04
+#define MIN_BODY_SAMPLES 50
+
+#define SETTLE_FRAMES 10
+#define SEARCH_SETTLE_FRAMES 30
+
+struct _DepthWindow
+{
+  guint begin;
+  guint end;
+
+  /* Body seen elsewhere, and for how many frames */
+  guint candidate;
+  guint n_candidate;
+};
+
+DepthWindow *
+depth_window_new (guint begin, guint end)
+{
+  DepthWindow *window;
+
+  window = g_slice_new0 (DepthWindow);
+  depth_window_set (window, begin, end);
+
+  return window;
+}
+
+void
+depth_window_free (DepthWindow *window)
+{
+  g_return_if_fail (window != NULL);
+
+  g_slice_free (DepthWindow, window);
+}
+
+/* Starts from the window BEGIN to END, e.g. after it was set by hand */
+void
+depth_window_set (DepthWindow *window, guint begin, guint end)
+{
+  g_return_if_fail (window != NULL);
+
+  window->begin = begin;
+  window->end = end;
+  window->candidate = 0;
+  window->n_candidate = 0;
+}
+
+/* Depth of the body in HISTOGRAM nearest to NEAR, or of the nearest
+   body if NEAR is 0; 0 if there is none */
+static guint
+find_body (const guint *histogram,
+           guint        n_bins,
+           guint        bin_size,
+           guint        near)
+{
+  guint i, first, total, min_count, body, best = 0;
+
+  /* The last bin has everything too far to tell */
+  first = MIN_DEPTH / bin_size;
+  total = 0;
+  for (i = first; i + 1 < n_bins; i++)
+    total += histogram[i];
+
+  min_count = MAX (total * MIN_BODY_FRACTION, MIN_BODY_SAMPLES);
+
+  /* Three bins at a time, so a body across two bins still counts */
+  for (i = MAX (first, 1); i + 2 < n_bins; i++)
+    {
+      guint count = histogram[i - 1] + histogram[i] + histogram[i + 1];
+
+      if (count < min_count)
+        continue;
+
+      /* Up to the top of that mode, then its fullest bin */
+      while (i + 2 < n_bins &&
+             histogram[i + 2] > histogram[i - 1])
+        i++;
+      if (histogram[i - 1] > histogram[i])
+        i--;
+      else if (histogram[i + 1] > histogram[i])
+        i++;
+
+      body = i * bin_size + bin_size / 2;
+      if (near == 0)
+        return body;
+      if (best == 0 ||
+          ABS ((gint) body - (gint) near) < ABS ((gint) best - (gint) near))
+        best = body;
+
+      /* Down the other side of that mode, to look for the next one */
+      while (i + 2 < n_bins && histogram[i + 1] <= histogram[i])
+        i++;
+    }
+
+  return best;
+}
+
+/* Looks for the user in the last frame's HISTOGRAM, made of N_BINS of
+   BIN_SIZE millimeters each, around HEAD_Z if the user's head was tracked
+   lately or 0 otherwise. Sets BEGIN and END to the window and returns
+   whether it changed. */
+gboolean
+depth_window_update (DepthWindow *window,
+                     const guint *histogram,
+                     guint        n_bins,
+                     guint        bin_size,
+                     guint        head_z,
+                     guint       *begin,
+                     guint       *end)
+{
+  guint body, new_end, settle_frames;
+  gboolean changed = FALSE;
+
+  g_return_val_if_fail (window != NULL && histogram != NULL, FALSE);
+
+  body = find_body (histogram, n_bins, bin_size, head_z);
+  settle_frames = head_z != 0 ? SETTLE_FRAMES : SEARCH_SETTLE_FRAMES;
+  new_end = body + BODY_BACK;
+
+  if (body == 0 || ABS ((gint) new_end - (gint) window->end) < HYSTERESIS)
+    {
+      window->n_candidate = 0;
+    }
+  else
+    {
+      if (window->n_candidate == 0 ||
+          ABS ((gint) body - (gint) window->candidate) >= HYSTERESIS)
+        {
+          window->candidate = body;
+          window->n_candidate = 0;
+        }
+
+      if (++window->n_candidate >= settle_frames)
+        {
+          window->begin = MAX (MIN_DEPTH, (gint) body - REACH);
+          window->end = body + BODY_BACK;
+          window->n_candidate = 0;
+          changed = TRUE;
+        }
+    }
+
+  if (begin != NULL)
+    *begin = window->begin;
+  if (end != NULL)
+    *end = window->end;
+
+  return changed;
+}
@@ -0,0 +1,46 @@
+/* Skeltrack Desktop Control: Depth Window
+ *
+ * Copyright (c) 2012 Igalia, S.L.
+ *
+ * Author: Joaquim Rocha <jrocha@igalia.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef __DEPTH_WINDOW_H__
+#define __DEPTH_WINDOW_H__
+
+#include <glib.h>
+
+typedef struct _DepthWindow DepthWindow;
+
+DepthWindow * depth_window_new     (guint begin,
+                                    guint end);
+
+void          depth_window_free    (DepthWindow *window);
+
+void          depth_window_set     (DepthWindow *window,
+                                    guint        begin,
+                                    guint        end);
+
+gboolean      depth_window_update  (DepthWindow *window,
+                                    const guint *histogram,
+                                    guint        n_bins,
+                                    guint        bin_size,
+                                    guint        head_z,
+                                    guint       *begin,
+                                    guint       *end);
+
+#endif /* __DEPTH_WINDOW_H__ */
@@ -0,0 +1,720 @@
+/* Skeltrack Desktop Control: DTW Recognizer
+ *
+ * Copyright (c) 2012 Igalia, S.L.
+ *
+ * Author: Joaquim Rocha <jrocha@igalia.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/* Recognizes hand trajectories by comparing them with recorded templates
+   using dynamic time warping.
+
+   Samples are the hands' positions relative to the head, in meters.
+   Every template is matched against every subsequence of the stream as
+   it arrives (the SPRING algorithm): a frame only updates one column of
+   accumulated distances per template and hand, and a template is
+   recognized as soon as the best path through all its points is close
+   enough. Paths may not stray more than the template's band from the
+   diagonal, which also bounds how slowly or fast it can be performed.
+
+   The templates' points are kept as a structure of arrays shared by all
+   of them, so the distances from a sample to every point of every
+   template are computed in one loop the compiler can vectorize.
+
+   Templates are read from a key file, one group per template:
+
+     [swipe-left]
+     points=0.30;-0.10;-0.40; 0.20;-0.10;-0.40; ...
+     action=key:Left
+     hand=right
+     threshold=0.08
+     band=0.5
+
+   "points" are X;Y;Z triplets sampled at the Kinect's 30 frames per
+   second. "action" is key:KEYSYM[+KEYSYM...] or button:N. "hand" is
+   left, right or any (the default). "threshold" is the root mean square
+   distance, in meters, under which the template is recognized (0.08 by
+   default) and "band" the largest warping allowed, as a fraction of the
+   template's length (0.5 by default). Templates can be recorded with
+   dtw_recognizer_dump_trajectory. */
+
+#include "dtw-recognizer.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <X11/Xlib.h>
+
+/* Around four seconds of samples */
+#define HISTORY_SIZE 128
+
+#define DEFAULT_THRESHOLD 0.08
+#define DEFAULT_BAND 0.5
+
+enum
+{
+  LEFT,
+  RIGHT,
+  N_HANDS
+};
+
+typedef struct
+{
+  gchar *name;
+  DtwAction action;
+  /* Mask of the hands it is matched against */
+  guint hands;
+  /* Index of its first point in the points' arrays */
+  guint offset;
+  guint length;
+  guint band;
+  /* Squared, to compare with the mean of the squared distances */
+  gfloat threshold;
+} Template;
+
+typedef struct
+{
+  gfloat x;
+  gfloat y;
+  gfloat z;
+} Sample;
+
+struct _DtwRecognizer
+{
+  GArray *templates;
+
+  /* Templates' points */
+  gfloat *points_x;
+  gfloat *points_y;
+  gfloat *points_z;
+  guint n_points;
+
+  /* For each hand and template point: the distance to the last sample,
+     the accumulated distance of the best path ending there and the
+     frame where that path started */
+  gfloat *costs[N_HANDS];
+  gfloat *distances[N_HANDS];
+  guint *starts[N_HANDS];
+
+  guint frame;
+
+  Sample history[N_HANDS][HISTORY_SIZE];
+  guint history_length[N_HANDS];
+};
+
+static const SkeltrackJointId hand_joints[N_HANDS] =
+{
+  SKELTRACK_JOINT_ID_LEFT_HAND,
+  SKELTRACK_JOINT_ID_RIGHT_HAND
+};
+
+static const gchar *hand_names[N_HANDS] =
+{
+  "left",
+  "right"
+};
+
+DtwRecognizer *
+dtw_recognizer_new (void)
+{
+  DtwRecognizer *recognizer;
+
+  recognizer = g_slice_new0 (DtwRecognizer);
+  recognizer->templates = g_array_new (FALSE, FALSE, sizeof (Template));
+
+  return recognizer;
+}
+
+static void
+free_points (DtwRecognizer *recognizer)
+{
+  guint i;
+
+  g_free (recognizer->points_x);
+  g_free (recognizer->points_y);
+  g_free (recognizer->points_z);
+  for (i = 0; i < N_HANDS; i++)
+    {
+      g_free (recognizer->costs[i]);
+      g_free (recognizer->distances[i]);
+      g_free (recognizer->starts[i]);
+    }
+}
+
+void
+dtw_recognizer_free (DtwRecognizer *recognizer)
+{
+  guint i;
+
+  g_return_if_fail (recognizer != NULL);
+
+  for (i = 0; i < recognizer->templates->len; i++)
+    g_free (g_array_index (recognizer->templates, Template, i).name);
+  g_array_free (recognizer->templates, TRUE);
+  free_points (recognizer);
+
+  g_slice_free (DtwRecognizer, recognizer);
+}
+
+guint
+dtw_recognizer_get_n_templates (DtwRecognizer *recognizer)
+{
+  g_return_val_if_fail (recognizer != NULL, 0);
+
+  return recognizer->templates->len;
+}
+
+static void
+reset_hand (DtwRecognizer *recognizer, guint hand)
+{
+  guint i;
+
+  for (i = 0; i < recognizer->n_points; i++)
+    recognizer->distances[hand][i] = INFINITY;
+}
+
+void
+dtw_recognizer_reset (DtwRecognizer *recognizer)
+{
+  guint i;
+
+  g_return_if_fail (recognizer != NULL);
+
+  for (i = 0; i < N_HANDS; i++)
+    {
+      reset_hand (recognizer, i);
+      recognizer->history_length[i] = 0;
+    }
+}
+
+static gboolean
+parse_action (const gchar *string, DtwAction *action)
+{
+  if (g_str_has_prefix (string, "key:"))
+    {
+      gchar **keys;
+      guint i;
+
+      keys = g_strsplit (string + strlen ("key:"), "+", -1);
+      action->type = DTW_ACTION_KEYS;
+      action->n_codes = g_strv_length (keys);
+      if (action->n_codes == 0 || action->n_codes > DTW_ACTION_MAX_KEYS)
+        {
+          g_strfreev (keys);
+          return FALSE;
+        }
+
+      for (i = 0; i < action->n_codes; i++)
+        {
+          action->codes[i] = XStringToKeysym (keys[i]);
+          if (action->codes[i] == NoSymbol)
+            {
+              g_strfreev (keys);
+              return FALSE;
+            }
+        }
+      g_strfreev (keys);
+
+      return TRUE;
+    }
+  else if (g_str_has_prefix (string, "button:"))
+    {
+      action->type = DTW_ACTION_BUTTON;
+      action->n_codes = 1;
+      action->codes[0] = atoi (string + strlen ("button:"));
+
+      return action->codes[0] > 0;
+    }
+
+  return FALSE;
+}
+
+static gboolean
+parse_hands (const gchar *string, guint *hands)
+{
+  if (g_strcmp0 (string, "left") == 0)
+    *hands = 1 << LEFT;
+  else if (g_strcmp0 (string, "right") == 0)
+    *hands = 1 << RIGHT;
+  else if (g_strcmp0 (string, "any") == 0)
+    *hands = (1 << LEFT) | (1 << RIGHT);
+  else
+    return FALSE;
+
+  return TRUE;
+}
+
+/* Sets VALUE to the group's KEY, or leaves it alone when there is none;
+   the value must be a number above 0 */
+static gboolean
+get_positive_double (GKeyFile *key_file,
+                     const gchar *group,
+                     const gchar *key,
+                     gdouble *value,
+                     GError **error)
+{
+  GError *tmp_error = NULL;
+  gdouble number;
+  gchar *string;
+
+  if (! g_key_file_has_key (key_file, group, key, NULL))
+    return TRUE;
+
+  number = g_key_file_get_double (key_file, group, key, &tmp_error);
+  if (tmp_error != NULL || number <= 0)
+    {
+      string = g_key_file_get_value (key_file, group, key, NULL);
+      g_set_error (error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_INVALID_VALUE,
+                   "[%s] has an invalid %s: %s", group, key, string);
+      g_free (string);
+      g_clear_error (&tmp_error);
+      return FALSE;
+    }
+
+  *value = number;
+
+  return TRUE;
+}
+
+static gboolean
+load_template (DtwRecognizer *recognizer,
+               GKeyFile *key_file,
+               const gchar *group,
+               GArray *points,
+               GError **error)
+{
+  Template template = { 0 };
+  gdouble *coordinates;
+  gdouble threshold, band;
+  gchar *string;
+  gsize n_coordinates;
+  gboolean valid;
+
+  coordinates = g_key_file_get_double_list (key_file,
+                                            group,
+                                            "points",
+                                            &n_coordinates,
+                                            error);
+  if (coordinates == NULL)
+    return FALSE;
+
+  if (n_coordinates % 3 != 0 || n_coordinates < 2 * 3)
+    {
+      g_set_error (error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_INVALID_VALUE,
+                   "[%s] needs at least two points of three coordinates",
+                   group);
+      g_free (coordinates);
+      return FALSE;
+    }
+
+  string = g_key_file_get_string (key_file, group, "action", error);
+  if (string == NULL)
+    {
+      g_free (coordinates);
+      return FALSE;
+    }
+  valid = parse_action (string, &template.action);
+  if (! valid)
+    g_set_error (error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_INVALID_VALUE,
+                 "[%s] has an invalid action: %s", group, string);
+  g_free (string);
+
+  template.hands = (1 << LEFT) | (1 << RIGHT);
+  if (valid && g_key_file_has_key (key_file, group, "hand", NULL))
+    {
+      string = g_key_file_get_string (key_file, group, "hand", NULL);
+      valid = parse_hands (string, &template.hands);
+      if (! valid)
+        g_set_error (error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_INVALID_VALUE,
+                     "[%s] has an invalid hand: %s", group, string);
+      g_free (string);
+    }
+
+  threshold = DEFAULT_THRESHOLD;
+  band = DEFAULT_BAND;
+  if (! valid ||
+      ! get_positive_double (key_file, group, "threshold", &threshold, error) ||
+      ! get_positive_double (key_file, group, "band", &band, error))
+    {
+      g_free (coordinates);
+      return FALSE;
+    }
+
+  template.threshold = threshold * threshold;
+  template.length = n_coordinates / 3;
+  template.band = template.length * band;
+  template.band = MAX (template.band, 1);
+
+  template.name = g_strdup (group);
+  template.offset = points->len / 3;
+  g_array_append_vals (points, coordinates, n_coordinates);
+  g_array_append_val (recognizer->templates, template);
+  g_free (coordinates);
+
+  return TRUE;
+}
+
+/* Replaces the points' arrays with the points of every template */
+static void
+set_points (DtwRecognizer *recognizer, GArray *points)
+{
+  const gdouble *coordinates;
+  guint i;
+
+  free_points (recognizer);
+
+  coordinates = (const gdouble *) points->data;
+  recognizer->n_points = points->len / 3;
+  recognizer->points_x = g_new (gfloat, recognizer->n_points);
+  recognizer->points_y = g_new (gfloat, recognizer->n_points);
+  recognizer->points_z = g_new (gfloat, recognizer->n_points);
+  for (i = 0; i < recognizer->n_points; i++)
+    {
+      recognizer->points_x[i] = coordinates[i * 3];
+      recognizer->points_y[i] = coordinates[i * 3 + 1];
+      recognizer->points_z[i] = coordinates[i * 3 + 2];
+    }
+
+  for (i = 0; i < N_HANDS; i++)
+    {
+      recognizer->costs[i] = g_new (gfloat, recognizer->n_points);
+      recognizer->distances[i] = g_new (gfloat, recognizer->n_points);
+      recognizer->starts[i] = g_new0 (guint, recognizer->n_points);
+      reset_hand (recognizer, i);
+    }
+}
+
+/* Adds the templates in FILENAME to the ones already loaded */
+gboolean
+dtw_recognizer_load (DtwRecognizer *recognizer,
+                     const gchar   *filename,
+                     GError       **error)
+{
+  GKeyFile *key_file;
+  GArray *points;
+  gchar **groups;
+  guint i, n_templates;
+  gboolean success = TRUE;
+
+  g_return_val_if_fail (recognizer != NULL, FALSE);
+  g_return_val_if_fail (filename != NULL, FALSE);
+
+  key_file = g_key_file_new ();
+  if (! g_key_file_load_from_file (key_file, filename, G_KEY_FILE_NONE, error))
+    {
+      g_key_file_free (key_file);
+      return FALSE;
+    }
+
+  /* The points of the templates already loaded come first */
+  points = g_array_new (FALSE, FALSE, sizeof (gdouble));
+  for (i = 0; i < recognizer->n_points; i++)
+    {
+      gdouble point[3];
+
+      point[0] = recognizer->points_x[i];
+      point[1] = recognizer->points_y[i];
+      point[2] = recognizer->points_z[i];
+      g_array_append_vals (points, point, 3);
+    }
+
+  n_templates = recognizer->templates->len;
+  groups = g_key_file_get_groups (key_file, NULL);
+  for (i = 0; groups[i] != NULL && success; i++)
+    success = load_template (recognizer, key_file, groups[i], points, error);
+
+  if (success)
+    {
+      set_points (recognizer, points);
+    }
+  else
+    {
+      g_prefix_error (error, "%s: ", filename);
+
+      for (i = n_templates; i < recognizer->templates->len; i++)
+        g_free (g_array_index (recognizer->templates, Template, i).name);
+      g_array_set_size (recognizer->templates, n_templates);
+    }
+
+  g_strfreev (groups);
+  g_array_free (points, TRUE);
+  g_key_file_free (key_file);
+
+  return success;
+}
+
+static void
+compute_costs (const gfloat * restrict points_x,
+               const gfloat * restrict points_y,
+               const gfloat * restrict points_z,
+               gfloat * restrict costs,
+               guint n_points,
+               const Sample *sample)
+{
+  guint i;
+
+  for (i = 0; i < n_points; i++)
+    {
+      gfloat dx, dy, dz;
+
+      dx = points_x[i] - sample->x;
+      dy = points_y[i] - sample->y;
+      dz = points_z[i] - sample->z;
+      costs[i] = dx * dx + dy * dy + dz * dz;
+    }
+}
+
+/* Takes DISTANCE as the best way into template point I if it is better
+   and the path from START stays within the band */
+static inline void
+consider_path (const Template *template,
+               guint           i,
+               guint           frame,
+               gfloat          distance,
+               guint           start,
+               gfloat         *best,
+               guint          *best_start)
+{
+  gint elapsed = frame - start;
+
+  if (distance < *best &&
+      (guint) ABS (elapsed - (gint) i) <= template->band)
+    {
+      *best = distance;
+      *best_start = start;
+    }
+}
+
+/* Moves a template's column of accumulated distances to the next frame
+   and returns the mean distance of the best path through all of it */
+static gfloat
+update_template (const Template *template,
+                 const gfloat *costs,
+                 gfloat *distances,
+                 guint *starts,
+                 guint frame)
+{
+  gfloat previous, previous_new;
+  guint previous_start, previous_new_start;
+  guint i;
+
+  costs += template->offset;
+  distances += template->offset;
+  starts += template->offset;
+
+  /* Any frame can be where a match starts */
+  previous = 0;
+  previous_start = frame;
+  previous_new = INFINITY;
+  previous_new_start = frame;
+
+  for (i = 0; i < template->length; i++)
+    {
+      gfloat best, old;
+      guint start, old_start;
+
+      old = distances[i];
+      old_start = starts[i];
+
+      /* Diagonal, then staying in the same template point, then
+         advancing in the template without a new sample; only the
+         ones within the band count */
+      best = INFINITY;
+      start = frame;
+      consider_path (template, i, frame, previous, previous_start,
+                     &best, &start);
+      consider_path (template, i, frame, old, old_start,
+                     &best, &start);
+      consider_path (template, i, frame, previous_new, previous_new_start,
+                     &best, &start);
+
+      previous = old;
+      previous_start = old_start;
+      previous_new = best + costs[i];
+      previous_new_start = start;
+
+      distances[i] = previous_new;
+      starts[i] = start;
+    }
+
+  return previous_new / template->length;
+}
+
+static void
+add_to_history (DtwRecognizer *recognizer, guint hand, const Sample *sample)
+{
+  recognizer->history[hand][recognizer->frame % HISTORY_SIZE] = *sample;
+  if (recognizer->history_length[hand] < HISTORY_SIZE)
+    recognizer->history_length[hand]++;
+}
+
+/* Feeds the positions in JOINT_LIST and tells whether that completed
+   any of the templates, filling MATCH with the closest one */
+gboolean
+dtw_recognizer_feed (DtwRecognizer     *recognizer,
+                     SkeltrackJointList joint_list,
+                     DtwMatch          *match)
+{
+  SkeltrackJoint *head;
+  const Template *best_template = NULL;
+  gfloat best_distance = INFINITY;
+  guint hand, i;
+
+  g_return_val_if_fail (recognizer != NULL, FALSE);
+
+  head = NULL;
+  if (joint_list != NULL)
+    head = skeltrack_joint_list_get_joint (joint_list,
+                                           SKELTRACK_JOINT_ID_HEAD);
+
+  for (hand = 0; hand < N_HANDS; hand++)
+    {
+      SkeltrackJoint *joint = NULL;
+      Sample sample;
+      const Template *hand_template = NULL;
+      gfloat hand_distance = INFINITY;
+
+      if (head != NULL)
+        joint = skeltrack_joint_list_get_joint (joint_list,
+                                                hand_joints[hand]);
+      if (joint == NULL)
+        {
+          /* A path cannot go over the frames a hand was not seen in */
+          reset_hand (recognizer, hand);
+          recognizer->history_length[hand] = 0;
+          continue;
+        }
+
+      sample.x = (joint->x - head->x) / 1000.f;
+      sample.y = (joint->y - head->y) / 1000.f;
+      sample.z = (joint->z - head->z) / 1000.f;
+      add_to_history (recognizer, hand, &sample);
+
+      compute_costs (recognizer->points_x,
+                     recognizer->points_y,
+                     recognizer->points_z,
+                     recognizer->costs[hand],
+                     recognizer->n_points,
+                     &sample);
+
+      for (i = 0; i < recognizer->templates->len; i++)
+        {
+          const Template *template;
+          gfloat distance;
+
+          template = &g_array_index (recognizer->templates, Template, i);
+          if ((template->hands & (1 << hand)) == 0)
+            continue;
+
+          distance = update_template (template,
+                                      recognizer->costs[hand],
+                                      recognizer->distances[hand],
+                                      recognizer->starts[hand],
+                                      recognizer->frame);
+          if (distance < template->threshold && distance < hand_distance)
+            {
+              hand_template = template;
+              hand_distance = distance;
+            }
+        }
+
+      if (hand_template != NULL)
+        {
+          /* Start over so the same movement is not recognized again */
+          reset_hand (recognizer, hand);
+          if (hand_distance < best_distance)
+            {
+              best_template = hand_template;
+              best_distance = hand_distance;
+            }
+        }
+    }
+
+  recognizer->frame++;
+
+  if (best_template == NULL)
+    return FALSE;
+
+  if (match != NULL)
+    {
+      match->name = best_template->name;
+      match->action = &best_template->action;
+      match->distance = sqrtf (best_distance);
+    }
+
+  return TRUE;
+}
+
+/* Writes the last N_SAMPLES positions of the hand that moved the most
+   as a template, to be completed with its name and action */
+gchar *
+dtw_recognizer_dump_trajectory (DtwRecognizer *recognizer, guint n_samples)
+{
+  GString *template;
+  gfloat longest = -1;
+  guint hand, best_hand = LEFT, i;
+
+  g_return_val_if_fail (recognizer != NULL, NULL);
+
+  for (hand = 0; hand < N_HANDS; hand++)
+    {
+      gfloat length = 0;
+      guint n;
+
+      n = MIN (n_samples, recognizer->history_length[hand]);
+      for (i = 1; i < n; i++)
+        {
+          const Sample *a, *b;
+          gfloat dx, dy, dz;
+
+          a = &recognizer->history[hand][(recognizer->frame - i) %
+                                         HISTORY_SIZE];
+          b = &recognizer->history[hand][(recognizer->frame - i - 1) %
+                                         HISTORY_SIZE];
+          dx = a->x - b->x;
+          dy = a->y - b->y;
+          dz = a->z - b->z;
+          length += sqrtf (dx * dx + dy * dy + dz * dz);
+        }
+
+      if (length > longest)
+        {
+          longest = length;
+          best_hand = hand;
+        }
+    }
+
+  n_samples = MIN (n_samples, recognizer->history_length[best_hand]);
+  if (n_samples < 2)
+    return NULL;
+
+  template = g_string_new ("[recorded]\n");
+  g_string_append_printf (template, "hand=%s\n", hand_names[best_hand]);
+  g_string_append (template, "action=key:\npoints=");
+  for (i = n_samples; i > 0; i--)
+    {
+      const Sample *sample;
+
+      sample = &recognizer->history[best_hand][(recognizer->frame - i) %
+                                               HISTORY_SIZE];
+      g_string_append_printf (template,
+                              "%.3f;%.3f;%.3f;",
+                              sample->x, sample->y, sample->z);
+    }
+  g_string_append_c (template, '\n');
+
+  return g_string_free (template, FALSE);
+}
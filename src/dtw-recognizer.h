@@ -0,0 +1,74 @@
+/* Skeltrack Desktop Control: DTW Recognizer
+ *
+ * Copyright (c) 2012 Igalia, S.L.
+ *
+ * Author: Joaquim Rocha <jrocha@igalia.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef __DTW_RECOGNIZER_H__
+#define __DTW_RECOGNIZER_H__
+
+#include <glib.h>
+#include <skeltrack.h>
+
+#define DTW_ACTION_MAX_KEYS 4
+
+typedef enum
+{
+  DTW_ACTION_KEYS,
+  DTW_ACTION_BUTTON
+} DtwActionType;
+
+/* What to do when a template is recognized: press the keys in order
+   and release them in reverse, or click a mouse button */
+typedef struct
+{
+  DtwActionType type;
+  guint codes[DTW_ACTION_MAX_KEYS];
+  guint n_codes;
+} DtwAction;
+
+typedef struct
+{
+  const gchar *name;
+  const DtwAction *action;
+  /* Root mean square distance to the template, in meters */
+  gfloat distance;
+} DtwMatch;
+
+typedef struct _DtwRecognizer DtwRecognizer;
+
+DtwRecognizer * dtw_recognizer_new              (void);
+
+void            dtw_recognizer_free             (DtwRecognizer *recognizer);
+
+gboolean        dtw_recognizer_load             (DtwRecognizer *recognizer,
+                                                 const gchar   *filename,
+                                                 GError       **error);
+
+guint           dtw_recognizer_get_n_templates  (DtwRecognizer *recognizer);
+
+void            dtw_recognizer_reset            (DtwRecognizer *recognizer);
+
+gboolean        dtw_recognizer_feed             (DtwRecognizer     *recognizer,
+                                                 SkeltrackJointList joint_list,
+                                                 DtwMatch          *match);
+
+gchar *         dtw_recognizer_dump_trajectory  (DtwRecognizer *recognizer,
+                                                 guint          n_samples);
+
+#endif /* __DTW_RECOGNIZER_H__ */
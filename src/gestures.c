@@ -0,0 +1,847 @@
+/* Skeltrack Desktop Control: Gestures
+ *
+ * Copyright (c) 2012 Igalia, S.L.
+ *
+ * Author: Joaquim Rocha <jrocha@igalia.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Interprets the hands' positions as gestures and turns them into
+   desktop events.
+
+   Everything a frame needs is kept by value in the state: the frames
+   seen are copied into a small ring and the hands are referred to by
+   which one they are, so once the state exists interpreting a frame
+   does not allocate any memory.
+
+   The head and hands are turned into millimeters, only for the pixels
+   around them, so the gestures do not depend on how far from the sensor
+   the user stands. */
+
+#include "gestures.h"
+#include "hand-shape.h"
+#include "point-cloud.h"
+
+#include <math.h>
+#include <X11/keysym.h>
+#include <X11/extensions/XTest.h>
+
+/* In pixels, around the hands' joints */
+#define SMOOTH_RADIUS 16
+
+typedef enum
+{
+  POINTER_NOTHING,
+  POINTER_ENTER,
+  POINTER_MOTION,
+  POINTER_BUTTON_PRESS,
+  POINTER_SCROLL
+} PointerState;
+
+struct _GestureState
+{
+  GestureConfig config;
+
+  Display *display;
+  gint screen_width;
+  gint screen_height;
+
+  /* When set, events are added here instead of being sent to X */
+  GArray *events;
+  gint pointer_x;
+  gint pointer_y;
+
+  PointerState pointer_1_state;
+  PointerState pointer_2_state;
+  /* Hand moving the pointer */
+  GestureHand pointer_1;
+  gint64 pointer_enter_time;
+  gint old_distance;
+  guint last_key;
+
+  GestureFrame history[GESTURE_HISTORY_SIZE];
+  guint n_frames;
+
+  /* For the size of the last frame */
+  PointCloud *cloud;
+
+  /* Shape of the hand moving the pointer, in grab mode */
+  HandShapeDetector *hand_shape;
+  GestureHand grab_hand;
+  gboolean grabbing;
+};
+
+GestureState *
+gesture_state_new (void)
+{
+  GestureState *state;
+
+  state = g_slice_new0 (GestureState);
+  state->config.threshold = 250;
+  state->config.action_half_width = 700;
+  state->config.action_above = 500;
+  state->config.action_below = 900;
+  state->config.timeout = 300;
+  state->config.double_hand_wheel_mode = TRUE;
+  state->config.wheel_turn_activate_distance = 120;
+  state->config.pinch_activate_distance = 250;
+  state->config.pointer_width = 700;
+  state->config.pointer_height = 450;
+  state->config.pointer_offset = 250;
+  state->pointer_1 = GESTURE_HAND_NONE;
+  state->old_distance = -1;
+  state->hand_shape = hand_shape_detector_new ();
+  state->grab_hand = GESTURE_HAND_NONE;
+
+  return state;
+}
+
+void
+gesture_state_free (GestureState *state)
+{
+  g_return_if_fail (state != NULL);
+
+  if (state->events != NULL)
+    g_array_free (state->events, TRUE);
+  if (state->cloud != NULL)
+    point_cloud_free (state->cloud);
+  hand_shape_detector_free (state->hand_shape);
+
+  g_slice_free (GestureState, state);
+}
+
+GestureConfig *
+gesture_state_get_config (GestureState *state)
+{
+  g_return_val_if_fail (state != NULL, NULL);
+
+  return &state->config;
+}
+
+void
+gesture_state_set_display (GestureState *state,
+                           Display      *display,
+                           gint          screen_width,
+                           gint          screen_height)
+{
+  g_return_if_fail (state != NULL);
+
+  state->display = display;
+  state->screen_width = screen_width;
+  state->screen_height = screen_height;
+}
+
+/* Keeps the events instead of sending them to X. Room for RESERVED
+   events is made up front so that keeping them does not allocate. */
+void
+gesture_state_capture_events (GestureState *state,
+                              gint          screen_width,
+                              gint          screen_height,
+                              guint         reserved)
+{
+  g_return_if_fail (state != NULL);
+
+  if (state->events == NULL)
+    state->events = g_array_sized_new (FALSE,
+                                       FALSE,
+                                       sizeof (InputEvent),
+                                       reserved);
+  state->screen_width = screen_width;
+  state->screen_height = screen_height;
+  gesture_state_clear_events (state);
+}
+
+const InputEvent *
+gesture_state_get_events (GestureState *state, guint *n_events)
+{
+  g_return_val_if_fail (state != NULL, NULL);
+
+  if (state->events == NULL)
+    {
+      *n_events = 0;
+      return NULL;
+    }
+
+  *n_events = state->events->len;
+  return (const InputEvent *) state->events->data;
+}
+
+void
+gesture_state_clear_events (GestureState *state)
+{
+  g_return_if_fail (state != NULL && state->events != NULL);
+
+  g_array_set_size (state->events, 0);
+  state->pointer_x = state->screen_width / 2;
+  state->pointer_y = state->screen_height / 2;
+}
+
+/* Forgets the gesture in progress, without releasing anything; call
+   gesture_state_release_all first if events may have been sent */
+void
+gesture_state_reset (GestureState *state)
+{
+  g_return_if_fail (state != NULL);
+
+  state->pointer_1_state = POINTER_NOTHING;
+  state->pointer_2_state = POINTER_NOTHING;
+  state->pointer_1 = GESTURE_HAND_NONE;
+  state->pointer_enter_time = 0;
+  state->old_distance = -1;
+  state->last_key = 0;
+  state->n_frames = 0;
+  state->grab_hand = GESTURE_HAND_NONE;
+  state->grabbing = FALSE;
+  hand_shape_detector_reset (state->hand_shape);
+}
+
+const GestureFrame *
+gesture_state_get_frame (GestureState *state, guint age)
+{
+  g_return_val_if_fail (state != NULL, NULL);
+
+  if (age >= GESTURE_HISTORY_SIZE || age >= state->n_frames)
+    return NULL;
+
+  return &state->history[(state->n_frames - 1 - age) % GESTURE_HISTORY_SIZE];
+}
+
+static gint
+get_distance (const GesturePoint *point_a, const GesturePoint *point_b)
+{
+  gint dx, dy, dz;
+  dx = point_a->x - point_b->x;
+  dy = point_a->y - point_b->y;
+  dz = point_a->z - point_b->z;
+  return sqrt (dx * dx + dy * dy + dz * dz);
+}
+
+static void
+get_pointer_position (Display *display, gint *x, gint *y)
+{
+  XEvent e;
+  Window root;
+  root = XRootWindow(display, 0);
+  XQueryPointer(display, root,
+                &e.xbutton.root, &e.xbutton.window,
+                &e.xbutton.x_root, &e.xbutton.y_root,
+                &e.xbutton.x, &e.xbutton.y,
+                &e.xbutton.state);
+  *x = e.xbutton.x_root;
+  *y = e.xbutton.y_root;
+}
+
+static void
+capture_event (GestureState *state,
+               InputEventType type,
+               guint code,
+               gint x,
+               gint y)
+{
+  InputEvent event;
+
+  event.type = type;
+  event.code = code;
+  event.x = x;
+  event.y = y;
+  event.time = state->history[(state->n_frames - 1) %
+                              GESTURE_HISTORY_SIZE].timestamp;
+  g_array_append_val (state->events, event);
+}
+
+static void
+set_mouse_pointer (GestureState *state,
+                   const GesturePoint *hand,
+                   const GesturePoint *head)
+{
+  gint pos_x, pos_y;
+  gdouble rel_x, rel_y;
+  if (state->display == NULL && state->events == NULL)
+    return;
+
+  if (state->events != NULL)
+    {
+      pos_x = state->pointer_x;
+      pos_y = state->pointer_y;
+    }
+  else
+    {
+      get_pointer_position (state->display, &pos_x, &pos_y);
+    }
+
+  /* Mirrored, as the sensor faces the user */
+  rel_x = (0.5 - (gdouble) (hand->x - head->x) /
+           state->config.pointer_width) * state->screen_width;
+  rel_y = (0.5 + (gdouble) (hand->y - head->y - state->config.pointer_offset) /
+           state->config.pointer_height) * state->screen_height;
+
+  pos_x += round ((rel_x - pos_x) / 8.f);
+  pos_y += round ((rel_y - pos_y) / 8.f);
+
+  if (state->events != NULL)
+    {
+      state->pointer_x = pos_x;
+      state->pointer_y = pos_y;
+      capture_event (state, INPUT_EVENT_MOTION, 0, pos_x, pos_y);
+      return;
+    }
+
+  XTestFakeMotionEvent(state->display, -1, pos_x, pos_y, CurrentTime);
+  XSync(state->display, 0);
+}
+
+static void
+key_down (GestureState *state, guint keysym)
+{
+  if (state->events != NULL)
+    {
+      capture_event (state, INPUT_EVENT_KEY_PRESS, keysym, 0, 0);
+      return;
+    }
+  if (state->display == NULL)
+    return;
+
+  XTestFakeKeyEvent (state->display,
+                     XKeysymToKeycode (state->display, keysym),
+                     TRUE,
+                     CurrentTime);
+  XSync(state->display, 0);
+}
+
+static void
+key_up (GestureState *state, guint keysym)
+{
+  if (state->events != NULL)
+    {
+      capture_event (state, INPUT_EVENT_KEY_RELEASE, keysym, 0, 0);
+      return;
+    }
+  if (state->display == NULL)
+    return;
+
+  XTestFakeKeyEvent (state->display,
+                     XKeysymToKeycode (state->display, keysym),
+                     FALSE,
+                     CurrentTime);
+  XSync(state->display, 0);
+}
+
+static void
+mouse_down (GestureState *state, guint button)
+{
+  if (state->events != NULL)
+    {
+      capture_event (state, INPUT_EVENT_BUTTON_PRESS, button, 0, 0);
+      return;
+    }
+  if (state->display == NULL)
+    return;
+
+  XTestFakeButtonEvent(state->display, button, TRUE, CurrentTime);
+  XSync(state->display, 0);
+}
+
+static void
+mouse_up (GestureState *state, guint button)
+{
+  if (state->events != NULL)
+    {
+      capture_event (state, INPUT_EVENT_BUTTON_RELEASE, button, 0, 0);
+      return;
+    }
+  if (state->display == NULL)
+    return;
+
+  XTestFakeButtonEvent(state->display, button, FALSE, CurrentTime);
+  XSync(state->display, 0);
+}
+
+static void
+mouse_click (GestureState *state, guint button)
+{
+  if (state->events != NULL)
+    {
+      capture_event (state, INPUT_EVENT_BUTTON_PRESS, button, 0, 0);
+      capture_event (state, INPUT_EVENT_BUTTON_RELEASE, button, 0, 0);
+      return;
+    }
+  if (state->display == NULL)
+    return;
+
+  XTestFakeButtonEvent(state->display, button, TRUE, CurrentTime);
+  XTestFakeButtonEvent(state->display, button, FALSE, CurrentTime);
+  XSync(state->display, 0);
+}
+
+/* Presses the keys in order and releases them in reverse,
+   for shortcuts like Control+Left */
+void
+gesture_state_send_keys (GestureState *state,
+                         const guint  *keysyms,
+                         guint         n_keysyms)
+{
+  guint i;
+
+  g_return_if_fail (state != NULL);
+
+  for (i = 0; i < n_keysyms; i++)
+    key_down (state, keysyms[i]);
+  for (i = n_keysyms; i > 0; i--)
+    key_up (state, keysyms[i - 1]);
+}
+
+void
+gesture_state_click (GestureState *state, guint button)
+{
+  g_return_if_fail (state != NULL);
+
+  mouse_click (state, button);
+}
+
+static void
+get_joint_point (GestureState *state,
+                 SkeltrackJoint *joint,
+                 GesturePoint *point)
+{
+  gfloat x, y;
+
+  point_cloud_get_point (state->cloud,
+                         MAX (joint->screen_x, 0),
+                         MAX (joint->screen_y, 0),
+                         joint->z,
+                         &x,
+                         &y);
+  point->x = x;
+  point->y = y;
+  point->z = joint->z;
+}
+
+static gboolean
+hand_is_active (GestureState *state,
+                const GesturePoint *head,
+                SkeltrackJoint *joint)
+{
+  GesturePoint hand;
+
+  if (joint == NULL)
+    return FALSE;
+
+  get_joint_point (state, joint, &hand);
+
+  return head->z - hand.z > state->config.threshold &&
+    ABS (hand.x - head->x) < state->config.action_half_width &&
+    hand.y - head->y > -state->config.action_above &&
+    hand.y - head->y < state->config.action_below;
+}
+
+/* The hand's position as the mean of the points around it
+   that are at about its depth */
+static gboolean
+smooth_point (GestureState *state,
+              const guint16 *buffer,
+              guint width,
+              guint height,
+              SkeltrackJoint *joint,
+              GesturePoint *closest)
+{
+  gfloat xs[SMOOTH_RADIUS * 2], ys[SMOOTH_RADIUS * 2], zs[SMOOTH_RADIUS * 2];
+  gfloat sum_x, sum_y, sum_z, min;
+  gint i, j, x, y, start, end, count;
+  x = joint->screen_x;
+  y = joint->screen_y;
+
+  if (x < 0 || y < 0 || x >= width || y >= height)
+    return FALSE;
+
+  get_joint_point (state, joint, closest);
+  sum_x = closest->x;
+  sum_y = closest->y;
+  sum_z = closest->z;
+  min = closest->z - 50;
+  count = 1;
+
+  start = MAX (x - SMOOTH_RADIUS, 0);
+  end = MIN (x + SMOOTH_RADIUS, (gint) width);
+
+  for (j = MAX (y - SMOOTH_RADIUS, 0);
+       j < MIN (y + SMOOTH_RADIUS, (gint) height);
+       j += 2)
+    {
+      point_cloud_convert_row (state->cloud,
+                               buffer + j * width + start,
+                               j,
+                               start,
+                               end - start,
+                               xs,
+                               ys,
+                               zs);
+
+      for (i = 0; i < end - start; i++)
+        {
+          if (zs[i] < closest->z && zs[i] >= min)
+            {
+              sum_x += xs[i];
+              sum_y += ys[i];
+              sum_z += zs[i];
+              count++;
+            }
+        }
+    }
+
+  closest->x = sum_x / count;
+  closest->y = sum_y / count;
+  closest->z = sum_z / count;
+
+  return TRUE;
+}
+
+/* Releases the button and keys a gesture in progress may be holding */
+void
+gesture_state_release_all (GestureState *state)
+{
+  g_return_if_fail (state != NULL);
+
+  mouse_up (state, 1);
+  state->pointer_1 = GESTURE_HAND_NONE;
+  state->grab_hand = GESTURE_HAND_NONE;
+  state->grabbing = FALSE;
+  state->pointer_1_state = POINTER_NOTHING;
+  state->pointer_2_state = POINTER_NOTHING;
+  state->old_distance = -1;
+
+  if (state->last_key != 0)
+    {
+      key_up (state, state->last_key);
+      key_up (state, XK_Up);
+      state->last_key = 0;
+    }
+}
+
+static void
+interpret_wheel_gesture (GestureState *state,
+                         const GesturePoint *pointer_1,
+                         const GesturePoint *pointer_2)
+{
+  /* Assuming pointer_1 is the left hand
+     and pointer_2 is the right hand */
+  guint keysym;
+
+  if (pointer_1->y < pointer_2->y)
+    keysym = XK_Right;
+  else
+    keysym = XK_Left;
+
+  if (state->last_key != 0 && keysym != state->last_key)
+    {
+      key_up (state, state->last_key);
+    }
+  if (ABS (pointer_1->y - pointer_2->y) /
+      state->config.wheel_turn_activate_distance != 0)
+    {
+      key_down (state, keysym);
+    }
+  else
+    {
+      key_up (state, keysym);
+    }
+  keysym = XK_Up;
+  key_down (state, keysym);
+  state->last_key = keysym;
+}
+
+static void
+interpret_pinch_gesture (GestureState *state,
+                         const GesturePoint *pointer_1,
+                         const GesturePoint *pointer_2)
+{
+  if (state->old_distance == -1)
+    {
+      state->old_distance = get_distance (pointer_1, pointer_2);
+    }
+  else
+    {
+      gint new_distance = get_distance (pointer_1, pointer_2);
+      if (ABS (state->old_distance - new_distance) >
+          state->config.pinch_activate_distance)
+        {
+          key_down (state, XK_Control_L);
+          if (state->old_distance < new_distance)
+            {
+              /* Scroll up */
+              mouse_click (state, 4);
+            }
+          else
+            {
+              /* Scroll down */
+              mouse_click (state, 5);
+            }
+          key_up (state, XK_Control_L);
+          state->old_distance = new_distance;
+        }
+    }
+}
+
+/* Presses the button as soon as the hand moving the pointer closes
+   and releases it when it opens */
+static void
+interpret_grab (GestureState *state,
+                const guint16 *buffer,
+                guint width,
+                guint height,
+                GestureHand hand,
+                SkeltrackJoint *joint,
+                const GesturePoint *point)
+{
+  HandShape shape;
+
+  if (hand != state->grab_hand)
+    {
+      if (state->grabbing)
+        mouse_up (state, 1);
+      state->grabbing = FALSE;
+      state->grab_hand = hand;
+      hand_shape_detector_reset (state->hand_shape);
+    }
+
+  shape = hand_shape_detector_update (state->hand_shape,
+                                      state->cloud,
+                                      buffer,
+                                      width,
+                                      height,
+                                      joint->screen_x,
+                                      joint->screen_y,
+                                      point->z);
+
+  if (shape == HAND_SHAPE_CLOSED && ! state->grabbing)
+    {
+      mouse_down (state, 1);
+      state->grabbing = TRUE;
+    }
+  else if (shape == HAND_SHAPE_OPEN && state->grabbing)
+    {
+      mouse_up (state, 1);
+      state->grabbing = FALSE;
+    }
+}
+
+void
+gesture_state_interpret (GestureState      *state,
+                         SkeltrackJointList joint_list,
+                         const guint16     *buffer,
+                         guint              width,
+                         guint              height,
+                         gint64             timestamp)
+{
+  GestureFrame *frame;
+  const GestureFrame *last_frame;
+  GesturePoint *left_point, *right_point, *single_point;
+  GestureHand single_hand;
+  SkeltrackJoint *head, *left_hand, *right_hand;
+  gboolean last_left, last_right;
+  gint64 timeout;
+
+  g_return_if_fail (state != NULL);
+
+  if (joint_list == NULL)
+    return;
+
+  head = skeltrack_joint_list_get_joint (joint_list,
+                                         SKELTRACK_JOINT_ID_HEAD);
+  left_hand = skeltrack_joint_list_get_joint (joint_list,
+                                              SKELTRACK_JOINT_ID_LEFT_HAND);
+  right_hand = skeltrack_joint_list_get_joint (joint_list,
+                                               SKELTRACK_JOINT_ID_RIGHT_HAND);
+
+  if (head == NULL)
+    return;
+
+  if (state->cloud == NULL ||
+      point_cloud_get_width (state->cloud) != width ||
+      point_cloud_get_height (state->cloud) != height)
+    {
+      if (state->cloud != NULL)
+        point_cloud_free (state->cloud);
+      state->cloud = point_cloud_new (width, height);
+    }
+
+  last_frame = gesture_state_get_frame (state, 0);
+  last_left = last_frame != NULL && last_frame->active[GESTURE_HAND_LEFT];
+  last_right = last_frame != NULL && last_frame->active[GESTURE_HAND_RIGHT];
+
+  /* The oldest frame's slot is reused for this one */
+  frame = &state->history[state->n_frames % GESTURE_HISTORY_SIZE];
+  state->n_frames++;
+
+  frame->timestamp = timestamp;
+  get_joint_point (state, head, &frame->head);
+  frame->active[GESTURE_HAND_LEFT] = FALSE;
+  frame->active[GESTURE_HAND_RIGHT] = FALSE;
+
+  left_point = NULL;
+  right_point = NULL;
+  single_point = NULL;
+  single_hand = GESTURE_HAND_NONE;
+  timeout = (gint64) state->config.timeout * 1000;
+
+  if (hand_is_active (state, &frame->head, left_hand))
+    {
+      if (smooth_point (state, buffer, width, height, left_hand,
+                        &frame->hands[GESTURE_HAND_LEFT]))
+        left_point = &frame->hands[GESTURE_HAND_LEFT];
+      single_point = left_point;
+      single_hand = GESTURE_HAND_LEFT;
+      if (hand_is_active (state, &frame->head, right_hand))
+        {
+          if (smooth_point (state, buffer, width, height, right_hand,
+                            &frame->hands[GESTURE_HAND_RIGHT]))
+            right_point = &frame->hands[GESTURE_HAND_RIGHT];
+          single_point = NULL;
+        }
+    }
+  else if (hand_is_active (state, &frame->head, right_hand))
+    {
+      if (smooth_point (state, buffer, width, height, right_hand,
+                        &frame->hands[GESTURE_HAND_RIGHT]))
+        right_point = &frame->hands[GESTURE_HAND_RIGHT];
+      single_point = right_point;
+      single_hand = GESTURE_HAND_RIGHT;
+    }
+
+  frame->active[GESTURE_HAND_LEFT] = left_point != NULL;
+  frame->active[GESTURE_HAND_RIGHT] = right_point != NULL;
+
+  /* Grab mode was turned off while grabbing */
+  if (state->grabbing && ! state->config.grab_mode)
+    {
+      mouse_up (state, 1);
+      state->grabbing = FALSE;
+      state->grab_hand = GESTURE_HAND_NONE;
+    }
+
+  if (single_point)
+    {
+      if (state->last_key != 0)
+        {
+          key_up (state, state->last_key);
+          state->last_key = 0;
+        }
+
+      if (state->pointer_1_state == POINTER_SCROLL)
+        {
+          state->pointer_1_state = POINTER_NOTHING;
+        }
+      else if (state->pointer_2_state == POINTER_BUTTON_PRESS)
+        {
+          mouse_up (state, 1);
+        }
+      else if (state->pointer_2_state == POINTER_ENTER)
+        {
+          mouse_click (state, 1);
+          state->pointer_2_state = POINTER_NOTHING;
+        }
+
+      if (state->pointer_1_state == POINTER_NOTHING)
+        {
+          state->pointer_enter_time = timestamp;
+          state->pointer_1_state = POINTER_ENTER;
+        }
+      else if (state->pointer_1_state == POINTER_MOTION ||
+               (state->pointer_1_state == POINTER_ENTER &&
+                timestamp - state->pointer_enter_time > timeout))
+        {
+          state->pointer_1_state = POINTER_MOTION;
+          state->pointer_2_state = POINTER_NOTHING;
+          state->pointer_1 = single_hand;
+          set_mouse_pointer (state, single_point, &frame->head);
+
+          if (state->config.grab_mode)
+            interpret_grab (state, buffer, width, height, single_hand,
+                            single_hand == GESTURE_HAND_LEFT ?
+                            left_hand : right_hand,
+                            single_point);
+        }
+    }
+  else if (left_point && right_point)
+    {
+      if (state->pointer_1_state == POINTER_MOTION)
+        {
+          /* One hand entered when the other was already
+             doing something; in grab mode, that hand clicks */
+          if (state->config.grab_mode)
+            {
+              state->pointer_2_state = POINTER_NOTHING;
+            }
+          else if (state->pointer_2_state == POINTER_NOTHING)
+            {
+              state->pointer_enter_time = timestamp;
+              state->pointer_2_state = POINTER_ENTER;
+            }
+          else if (state->pointer_2_state == POINTER_ENTER &&
+                   timestamp - state->pointer_enter_time > timeout)
+            {
+              state->pointer_2_state = POINTER_BUTTON_PRESS;
+              mouse_down (state, 1);
+            }
+
+          /* The hand moving the pointer keeps doing it only
+             if it was seen doing it in the last frame */
+          if ((state->pointer_1 == GESTURE_HAND_LEFT && ! last_left) ||
+              (state->pointer_1 == GESTURE_HAND_RIGHT && ! last_right))
+            state->pointer_1 = GESTURE_HAND_NONE;
+
+          if (state->pointer_1 != GESTURE_HAND_NONE)
+            {
+              set_mouse_pointer (state,
+                                 &frame->hands[state->pointer_1],
+                                 &frame->head);
+
+              if (state->config.grab_mode)
+                interpret_grab (state, buffer, width, height,
+                                state->pointer_1,
+                                state->pointer_1 == GESTURE_HAND_LEFT ?
+                                left_hand : right_hand,
+                                &frame->hands[state->pointer_1]);
+            }
+        }
+      else
+        {
+          /* Both hands entered at the same time*/
+          state->pointer_1 = GESTURE_HAND_LEFT;
+          state->pointer_1_state = POINTER_SCROLL;
+          state->pointer_2_state = POINTER_SCROLL;
+
+          /* Skip the first time where both hands entered */
+          if (last_left && last_right)
+            {
+              if (state->config.double_hand_wheel_mode)
+                {
+                  interpret_wheel_gesture (state,
+                                           left_point,
+                                           right_point);
+                }
+              else
+                {
+                  interpret_pinch_gesture (state,
+                                           left_point,
+                                           right_point);
+                }
+            }
+        }
+    }
+  else if (last_left || last_right)
+    {
+      gesture_state_release_all (state);
+    }
+}
@@ -0,0 +1,142 @@
+/* Skeltrack Desktop Control: Gestures
+ *
+ * Copyright (c) 2012 Igalia, S.L.
+ *
+ * Author: Joaquim Rocha <jrocha@igalia.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GESTURES_H__
+#define __GESTURES_H__
+
+#include <glib.h>
+#include <skeltrack.h>
+#include <X11/Xlib.h>
+
+#include "input-event.h"
+
+/* Number of recent frames kept by the gestures */
+#define GESTURE_HISTORY_SIZE 8
+
+typedef enum
+{
+  GESTURE_HAND_NONE = -1,
+  GESTURE_HAND_LEFT,
+  GESTURE_HAND_RIGHT
+} GestureHand;
+
+/* In millimeters, in the camera's coordinates
+   (X right, Y down, Z away from the sensor) */
+typedef struct
+{
+  gint x;
+  gint y;
+  gint z;
+} GesturePoint;
+
+/* What the gestures saw of a frame: the head and the
+   hands that were in the action area */
+typedef struct
+{
+  gint64 timestamp;
+  GesturePoint head;
+  GesturePoint hands[2];
+  gboolean active[2];
+} GestureFrame;
+
+/* Distances are in millimeters */
+typedef struct
+{
+  /* How far in front of the head a hand must be to be
+     in the action area */
+  gint threshold;
+
+  /* Size of the action area around the head: to each side,
+     above and below it */
+  gint action_half_width;
+  gint action_above;
+  gint action_below;
+
+  /* Timeout after a hand gets ready to be interpreted
+     and it actually is. In milliseconds. */
+  guint timeout;
+
+  /* Affect how two hands gestures should be interpreted */
+  gboolean double_hand_wheel_mode;
+
+  /* Press the button by closing the hand moving the pointer, and
+     release it by opening it, instead of with the other hand */
+  gboolean grab_mode;
+
+  /* Height difference between the hands so that it should
+     be considered as "steering wheel turned" gesture */
+  guint wheel_turn_activate_distance;
+
+  /* Change in the distance between the hands so that it
+     should be considered a pinch gesture */
+  guint pinch_activate_distance;
+
+  /* Area in front of the user mapped to the whole screen,
+     centered that far below the head */
+  gint pointer_width;
+  gint pointer_height;
+  gint pointer_offset;
+} GestureConfig;
+
+typedef struct _GestureState GestureState;
+
+GestureState *       gesture_state_new                (void);
+
+void                 gesture_state_free               (GestureState *state);
+
+GestureConfig *      gesture_state_get_config         (GestureState *state);
+
+void                 gesture_state_set_display        (GestureState *state,
+                                                       Display      *display,
+                                                       gint          screen_width,
+                                                       gint          screen_height);
+
+void                 gesture_state_capture_events     (GestureState *state,
+                                                       gint          screen_width,
+                                                       gint          screen_height,
+                                                       guint         reserved);
+
+const InputEvent *   gesture_state_get_events         (GestureState *state,
+                                                       guint        *n_events);
+
+void                 gesture_state_clear_events       (GestureState *state);
+
+void                 gesture_state_reset              (GestureState *state);
+
+void                 gesture_state_release_all        (GestureState *state);
+
+void                 gesture_state_interpret          (GestureState      *state,
+                                                       SkeltrackJointList joint_list,
+                                                       const guint16     *buffer,
+                                                       guint              width,
+                                                       guint              height,
+                                                       gint64             timestamp);
+
+void                 gesture_state_send_keys          (GestureState *state,
+                                                       const guint  *keysyms,
+                                                       guint         n_keysyms);
+
+void                 gesture_state_click              (GestureState *state,
+                                                       guint         button);
+
+const GestureFrame * gesture_state_get_frame          (GestureState *state,
+                                                       guint         age);
+
+#endif /* __GESTURES_H__ */
@@ -0,0 +1,382 @@
+/* Skeltrack Desktop Control: Hand Shape
+ *
+ * Copyright (c) 2012 Igalia, S.L.
+ *
+ * Author: Joaquim Rocha <jrocha@igalia.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/* Tells an open hand from a closed one by the blob of pixels at the
+   hand's depth around its joint. An open hand covers more and, with its
+   fingers apart, fills less of its convex hull (its solidity is lower)
+   than a fist does.
+
+   Both measures have a margin between what is open and what is closed,
+   and a new shape must be seen in HAND_SHAPE_FRAMES frames in a row, so
+   the shape does not flicker between frames. Everything is kept in the
+   detector, which does not allocate after being created. */
+
+#include "hand-shape.h"
+
+#include <math.h>
+#include <string.h>
+
+/* Millimeters around the hand's joint that are looked at, and how far
+   in front of and behind the hand's depth a pixel can be. The forearm
+   goes back from the wrist, so little is allowed behind the hand or a
+   forearm held close to it would be taken as part of it */
+#define HAND_RADIUS 130
+#define HAND_FRONT 60
+#define HAND_BACK 45
+
+/* In pixels, the most HAND_RADIUS can become when the hand is close */
+#define MAX_RADIUS 96
+#define MAX_SIDE (MAX_RADIUS * 2 + 1)
+
+/* In square millimeters; smaller blobs are not a hand */
+#define MIN_AREA 2500
+
+/* A hand is closed when its blob is smaller and more solid than the
+   first values, and open when bigger or less solid than the second */
+#define CLOSED_AREA 12000
+#define CLOSED_SOLIDITY 0.88
+#define OPEN_AREA 15000
+#define OPEN_SOLIDITY 0.8
+
+#define HAND_SHAPE_FRAMES 2
+
+typedef struct
+{
+  gint x;
+  gint y;
+} HullPoint;
+
+struct _HandShapeDetector
+{
+  HandShape shape;
+  HandShape candidate;
+  guint n_candidate;
+
+  gint area;
+  gfloat solidity;
+
+  /* Pixels of the window around the hand: whether they are at its
+     depth, then whether they were reached from the joint */
+  guint8 mask[MAX_SIDE * MAX_SIDE];
+  guint32 stack[MAX_SIDE * MAX_SIDE];
+  HullPoint points[MAX_SIDE * 2];
+  HullPoint hull[MAX_SIDE * 2 + 1];
+};
+
+enum
+{
+  PIXEL_OUTSIDE,
+  PIXEL_INSIDE,
+  PIXEL_BLOB
+};
+
+HandShapeDetector *
+hand_shape_detector_new (void)
+{
+  return g_new0 (HandShapeDetector, 1);
+}
+
+void
+hand_shape_detector_free (HandShapeDetector *detector)
+{
+  g_return_if_fail (detector != NULL);
+
+  g_free (detector);
+}
+
+void
+hand_shape_detector_reset (HandShapeDetector *detector)
+{
+  g_return_if_fail (detector != NULL);
+
+  detector->shape = HAND_SHAPE_UNKNOWN;
+  detector->candidate = HAND_SHAPE_UNKNOWN;
+  detector->n_candidate = 0;
+  detector->area = 0;
+  detector->solidity = 0;
+}
+
+/* Marks the pixels of the blob connected to the one closest to the
+   window's center and returns how many there are */
+static guint
+fill_blob (HandShapeDetector *detector, gint side)
+{
+  gint center, i, j, best, best_distance;
+  guint n_stack, n_pixels;
+
+  center = side / 2;
+  best = -1;
+  best_distance = G_MAXINT;
+  for (j = MAX (center - 3, 0); j <= MIN (center + 3, side - 1); j++)
+    for (i = MAX (center - 3, 0); i <= MIN (center + 3, side - 1); i++)
+      {
+        gint distance = (i - center) * (i - center) +
+          (j - center) * (j - center);
+
+        if (detector->mask[j * side + i] == PIXEL_INSIDE &&
+            distance < best_distance)
+          {
+            best = j * side + i;
+            best_distance = distance;
+          }
+      }
+
+  if (best < 0)
+    return 0;
+
+  detector->mask[best] = PIXEL_BLOB;
+  detector->stack[0] = best;
+  n_stack = 1;
+  n_pixels = 0;
+  while (n_stack > 0)
+    {
+      guint index = detector->stack[--n_stack];
+      gint x = index % side;
+      gint y = index / side;
+
+      n_pixels++;
+
+#define VISIT(condition, neighbor)                              \
+      if ((condition) &&                                        \
+          detector->mask[neighbor] == PIXEL_INSIDE)             \
+        {                                                       \
+          detector->mask[neighbor] = PIXEL_BLOB;                \
+          detector->stack[n_stack++] = (neighbor);              \
+        }
+
+      VISIT (x > 0, index - 1);
+      VISIT (x < side - 1, index + 1);
+      VISIT (y > 0, index - side);
+      VISIT (y < side - 1, index + side);
+
+#undef VISIT
+    }
+
+  return n_pixels;
+}
+
+static gint
+cross (const HullPoint *o, const HullPoint *a, const HullPoint *b)
+{
+  return (a->x - o->x) * (b->y - o->y) - (a->y - o->y) * (b->x - o->x);
+}
+
+/* Area, in pixels, of the convex hull of the blob. The hull only
+   depends on the first and last pixel of each of the blob's rows,
+   which come out sorted, so it is built with a monotone chain. */
+static gfloat
+get_hull_area (HandShapeDetector *detector, gint side)
+{
+  HullPoint *points, *hull;
+  gint i, j, n_points, n_hull, lower;
+  gfloat area, perimeter;
+
+  points = detector->points;
+  hull = detector->hull;
+
+  n_points = 0;
+  for (j = 0; j < side; j++)
+    {
+      const guint8 *row = detector->mask + j * side;
+      gint first = -1, last = -1;
+
+      for (i = 0; i < side; i++)
+        if (row[i] == PIXEL_BLOB)
+          {
+            if (first < 0)
+              first = i;
+            last = i;
+          }
+
+      if (first < 0)
+        continue;
+
+      points[n_points].x = first;
+      points[n_points++].y = j;
+      if (last != first)
+        {
+          points[n_points].x = last;
+          points[n_points++].y = j;
+        }
+    }
+
+  if (n_points < 3)
+    return n_points;
+
+  n_hull = 0;
+  for (i = 0; i < n_points; i++)
+    {
+      while (n_hull >= 2 &&
+             cross (&hull[n_hull - 2], &hull[n_hull - 1], &points[i]) <= 0)
+        n_hull--;
+      hull[n_hull++] = points[i];
+    }
+  lower = n_hull + 1;
+  for (i = n_points - 2; i >= 0; i--)
+    {
+      while (n_hull >= lower &&
+             cross (&hull[n_hull - 2], &hull[n_hull - 1], &points[i]) <= 0)
+        n_hull--;
+      hull[n_hull++] = points[i];
+    }
+  /* The first point was added again at the end */
+  n_hull--;
+
+  area = 0;
+  perimeter = 0;
+  for (i = 0; i < n_hull; i++)
+    {
+      const HullPoint *a = &hull[i];
+      const HullPoint *b = &hull[(i + 1) % n_hull];
+
+      area += a->x * b->y - b->x * a->y;
+      perimeter += sqrtf ((b->x - a->x) * (b->x - a->x) +
+                          (b->y - a->y) * (b->y - a->y));
+    }
+
+  /* The hull goes through the pixels' centers, while the blob's
+     pixels are counted whole: add the half pixel around it */
+  return ABS (area) / 2 + perimeter / 2 + 1;
+}
+
+/* The shape of the blob alone, or UNKNOWN if it is in between */
+static HandShape
+classify (HandShapeDetector *detector)
+{
+  if (detector->area < MIN_AREA)
+    return HAND_SHAPE_UNKNOWN;
+
+  if (detector->area <= CLOSED_AREA &&
+      detector->solidity >= CLOSED_SOLIDITY)
+    return HAND_SHAPE_CLOSED;
+
+  if (detector->area >= OPEN_AREA ||
+      detector->solidity <= OPEN_SOLIDITY)
+    return HAND_SHAPE_OPEN;
+
+  return HAND_SHAPE_UNKNOWN;
+}
+
+/* Looks at the hand whose joint is at pixel (X, Y) of BUFFER and
+   whose front is Z millimeters away. Returns the shape it has had
+   for the last frames. */
+HandShape
+hand_shape_detector_update (HandShapeDetector *detector,
+                            PointCloud        *cloud,
+                            const guint16     *buffer,
+                            guint              width,
+                            guint              height,
+                            gint               x,
+                            gint               y,
+                            gint               z)
+{
+  gfloat x0, y0, x1, y1, pixel_width, pixel_height;
+  gint radius, side, i, j, start_x, start_y, min_depth, max_depth;
+  guint n_pixels;
+  HandShape shape;
+
+  g_return_val_if_fail (detector != NULL, HAND_SHAPE_UNKNOWN);
+
+  if (x < 0 || y < 0 || x + 1 >= width || y + 1 >= height || z <= 0)
+    return detector->shape;
+
+  /* Size of a pixel at the hand's depth */
+  point_cloud_get_point (cloud, x, y, z, &x0, &y0);
+  point_cloud_get_point (cloud, x + 1, y + 1, z, &x1, &y1);
+  pixel_width = x1 - x0;
+  pixel_height = y1 - y0;
+
+  radius = MIN (HAND_RADIUS / pixel_width, MAX_RADIUS);
+  side = radius * 2 + 1;
+  start_x = x - radius;
+  start_y = y - radius;
+
+  min_depth = z - HAND_FRONT;
+  max_depth = z + HAND_BACK;
+  for (j = 0; j < side; j++)
+    {
+      gint row = start_y + j;
+      guint8 *mask = detector->mask + j * side;
+
+      if (row < 0 || row >= height)
+        {
+          memset (mask, PIXEL_OUTSIDE, side);
+          continue;
+        }
+
+      for (i = 0; i < side; i++)
+        {
+          gint column = start_x + i;
+          gint depth;
+
+          if (column < 0 || column >= width)
+            {
+              mask[i] = PIXEL_OUTSIDE;
+              continue;
+            }
+
+          depth = buffer[row * width + column];
+          mask[i] = depth >= min_depth && depth <= max_depth ?
+            PIXEL_INSIDE : PIXEL_OUTSIDE;
+        }
+    }
+
+  n_pixels = fill_blob (detector, side);
+  detector->area = n_pixels * pixel_width * pixel_height;
+  detector->solidity = n_pixels > 0 ?
+    MIN (n_pixels / get_hull_area (detector, side), 1.0) : 0;
+
+  shape = classify (detector);
+  if (shape == HAND_SHAPE_UNKNOWN || shape == detector->shape)
+    {
+      detector->n_candidate = 0;
+      return detector->shape;
+    }
+
+  if (shape != detector->candidate)
+    {
+      detector->candidate = shape;
+      detector->n_candidate = 0;
+    }
+
+  if (++detector->n_candidate >= HAND_SHAPE_FRAMES)
+    {
+      detector->shape = shape;
+      detector->n_candidate = 0;
+    }
+
+  return detector->shape;
+}
+
+/* The blob's area, in square millimeters, and solidity in the last
+   frame, to tune the thresholds */
+void
+hand_shape_detector_get_measures (HandShapeDetector *detector,
+                                  gint              *area,
+                                  gfloat            *solidity)
+{
+  g_return_if_fail (detector != NULL);
+
+  if (area != NULL)
+    *area = detector->area;
+  if (solidity != NULL)
+    *solidity = detector->solidity;
+}
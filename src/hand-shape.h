@@ -0,0 +1,57 @@
+/* Skeltrack Desktop Control: Hand Shape
+ *
+ * Copyright (c) 2012 Igalia, S.L.
+ *
+ * Author: Joaquim Rocha <jrocha@igalia.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef __HAND_SHAPE_H__
+#define __HAND_SHAPE_H__
+
+#include <glib.h>
+
+#include "point-cloud.h"
+
+typedef enum
+{
+  HAND_SHAPE_UNKNOWN,
+  HAND_SHAPE_OPEN,
+  HAND_SHAPE_CLOSED
+} HandShape;
+
+typedef struct _HandShapeDetector HandShapeDetector;
+
+HandShapeDetector * hand_shape_detector_new      (void);
+
+void                hand_shape_detector_free     (HandShapeDetector *detector);
+
+void                hand_shape_detector_reset    (HandShapeDetector *detector);
+
+HandShape           hand_shape_detector_update   (HandShapeDetector *detector,
+                                                  PointCloud        *cloud,
+                                                  const guint16     *buffer,
+                                                  guint              width,
+                                                  guint              height,
+                                                  gint               x,
+                                                  gint               y,
+                                                  gint               z);
+
+void                hand_shape_detector_get_measures (HandShapeDetector *detector,
+                                                      gint              *area,
+                                                      gfloat            *solidity);
+
+#endif /* __HAND_SHAPE_H__ */
@@ -0,0 +1,47 @@
+/* Skeltrack Desktop Control: Input Event
+ *
+ * Copyright (c) 2012 Igalia, S.L.
+ *
+ * Author: Joaquim Rocha <jrocha@igalia.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __INPUT_EVENT_H__
+#define __INPUT_EVENT_H__
+
+#include <glib.h>
+
+/* The events the gestures produce, kept instead of being sent to the
+   X server when the pipeline runs without a desktop (e.g. benchmarks) */
+typedef enum
+{
+  INPUT_EVENT_MOTION,
+  INPUT_EVENT_KEY_PRESS,
+  INPUT_EVENT_KEY_RELEASE,
+  INPUT_EVENT_BUTTON_PRESS,
+  INPUT_EVENT_BUTTON_RELEASE
+} InputEventType;
+
+typedef struct
+{
+  InputEventType type;
+  /* Key symbol or mouse button; for motion, the pointer position */
+  guint code;
+  gint x;
+  gint y;
+  gint64 time;
+} InputEvent;
+
+#endif /* __INPUT_EVENT_H__ */
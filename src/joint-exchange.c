@@ -0,0 +1,126 @@
+/* Skeltrack Desktop Control: Joint Exchange
+ *
+ * Copyright (c) 2012 Igalia, S.L.
+ *
+ * Author: Joaquim Rocha <jrocha@igalia.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/* Hands the latest joints tracked to a reader, such as the view,
+   without either of them ever waiting for the other.
+
+   It is a triple buffer: the tracker owns one slot, which it fills, the
+   reader owns another, which it reads, and the third one holds the
+   latest list published. Publishing swaps the tracker's slot with the
+   latest one and reading swaps the reader's slot with it if it is newer,
+   each with a single atomic operation on the index of the latest slot.
+
+   The exchange owns the lists published to it. A list is freed when the
+   tracker gets its slot back with it, which means it was either read and
+   then replaced by a newer one, or never read, and the last three are
+   freed with the exchange. So every list is freed exactly once, always
+   by the tracker, and the one the reader got stays valid until it reads
+   again. There is one tracker and one reader per exchange. */
+
+#include "joint-exchange.h"
+
+/* Set along with the index of the latest slot until it is read */
+#define SLOT_NEW 4
+#define SLOT_MASK 3
+
+struct _JointExchange
+{
+  SkeltrackJointList slots[3];
+  volatile gint latest;
+  /* Only touched by the tracker and by the reader, respectively */
+  gint back;
+  gint front;
+};
+
+JointExchange *
+joint_exchange_new (void)
+{
+  JointExchange *exchange;
+
+  exchange = g_slice_new0 (JointExchange);
+  exchange->back = 0;
+  exchange->latest = 1;
+  exchange->front = 2;
+
+  return exchange;
+}
+
+void
+joint_exchange_free (JointExchange *exchange)
+{
+  guint i;
+
+  g_return_if_fail (exchange != NULL);
+
+  for (i = 0; i < G_N_ELEMENTS (exchange->slots); i++)
+    if (exchange->slots[i] != NULL)
+      skeltrack_joint_list_free (exchange->slots[i]);
+
+  g_slice_free (JointExchange, exchange);
+}
+
+static gint
+swap_latest (JointExchange *exchange, gint slot)
+{
+  gint latest;
+
+  do
+    latest = g_atomic_int_get (&exchange->latest);
+  while (! g_atomic_int_compare_and_exchange (&exchange->latest,
+                                              latest,
+                                              slot));
+
+  return latest;
+}
+
+/* Makes LIST, which may be NULL when nobody was found, the latest joints.
+   The exchange takes ownership of it. */
+void
+joint_exchange_publish (JointExchange *exchange, SkeltrackJointList list)
+{
+  g_return_if_fail (exchange != NULL);
+
+  if (exchange->slots[exchange->back] != NULL)
+    skeltrack_joint_list_free (exchange->slots[exchange->back]);
+  exchange->slots[exchange->back] = list;
+
+  exchange->back = swap_latest (exchange, exchange->back | SLOT_NEW) &
+    SLOT_MASK;
+}
+
+/* Sets LIST to the latest joints published, which belong to the
+   exchange and stay valid until the next call. Returns whether they
+   are newer than the ones of the last call. */
+gboolean
+joint_exchange_read (JointExchange *exchange, SkeltrackJointList *list)
+{
+  gboolean is_new;
+
+  g_return_val_if_fail (exchange != NULL && list != NULL, FALSE);
+
+  is_new = (g_atomic_int_get (&exchange->latest) & SLOT_NEW) != 0;
+  if (is_new)
+    exchange->front = swap_latest (exchange, exchange->front) & SLOT_MASK;
+
+  *list = exchange->slots[exchange->front];
+
+  return is_new;
+}
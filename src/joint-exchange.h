@@ -0,0 +1,40 @@
+/* Skeltrack Desktop Control: Joint Exchange
+ *
+ * Copyright (c) 2012 Igalia, S.L.
+ *
+ * Author: Joaquim Rocha <jrocha@igalia.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef __JOINT_EXCHANGE_H__
+#define __JOINT_EXCHANGE_H__
+
+#include <glib.h>
+#include <skeltrack.h>
+
+typedef struct _JointExchange JointExchange;
+
+JointExchange *    joint_exchange_new       (void);
+
+void               joint_exchange_free      (JointExchange *exchange);
+
+void               joint_exchange_publish   (JointExchange     *exchange,
+                                             SkeltrackJointList list);
+
+gboolean           joint_exchange_read      (JointExchange      *exchange,
+                                             SkeltrackJointList *list);
+
+#endif /* __JOINT_EXCHANGE_H__ */
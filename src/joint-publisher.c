@@ -0,0 +1,434 @@
+/* Skeltrack Desktop Control: Joint Publisher
+ *
+ * Copyright (c) 2012 Igalia, S.L.
+ *
+ * Author: Joaquim Rocha <jrocha@igalia.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "joint-publisher.h"
+#include "joint-stream.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <gio/gio.h>
+
+typedef struct
+{
+  JointPublisher *publisher;
+  GIOChannel *channel;
+  guint watch_id;
+  gboolean subscribed;
+  gchar request[32];
+  gsize request_len;
+} Subscriber;
+
+struct _JointPublisher
+{
+  gchar *socket_path;
+  GIOChannel *channel;
+  guint watch_id;
+  GList *subscribers;
+  guint n_subscribers;
+
+  gchar *shm_name;
+  guchar *memory;
+  gsize memory_size;
+  JointStreamHeader *header;
+  guint32 frame_count;
+};
+
+static void
+subscriber_free (Subscriber *subscriber)
+{
+  JointPublisher *publisher = subscriber->publisher;
+
+  if (subscriber->subscribed)
+    publisher->n_subscribers--;
+  publisher->subscribers = g_list_remove (publisher->subscribers, subscriber);
+
+  if (subscriber->watch_id != 0)
+    g_source_remove (subscriber->watch_id);
+  g_io_channel_unref (subscriber->channel);
+  g_slice_free (Subscriber, subscriber);
+}
+
+static void
+subscriber_reply (Subscriber *subscriber, const gchar *reply)
+{
+  gint fd = g_io_channel_unix_get_fd (subscriber->channel);
+
+  /* Replies are tiny, if the socket buffer cannot take them
+     the subscriber is not reading and will not be missed */
+  send (fd, reply, strlen (reply), MSG_NOSIGNAL | MSG_DONTWAIT);
+}
+
+static void
+subscriber_handle_request (Subscriber *subscriber, const gchar *request)
+{
+  JointPublisher *publisher = subscriber->publisher;
+
+  if (g_strcmp0 (request, "SUBSCRIBE") == 0)
+    {
+      gchar *reply;
+
+      if (! subscriber->subscribed)
+        {
+          subscriber->subscribed = TRUE;
+          publisher->n_subscribers++;
+          g_debug ("Joint stream subscriber added (%d)",
+                   publisher->n_subscribers);
+        }
+
+      reply = g_strdup_printf ("OK %s\n", publisher->shm_name);
+      subscriber_reply (subscriber, reply);
+      g_free (reply);
+    }
+  else if (g_strcmp0 (request, "UNSUBSCRIBE") == 0)
+    {
+      if (subscriber->subscribed)
+        {
+          subscriber->subscribed = FALSE;
+          publisher->n_subscribers--;
+        }
+      subscriber_reply (subscriber, "OK\n");
+    }
+  else
+    {
+      subscriber_reply (subscriber, "ERROR unknown request\n");
+    }
+}
+
+static gboolean
+on_subscriber_io (GIOChannel *channel,
+                  GIOCondition condition,
+                  gpointer user_data)
+{
+  Subscriber *subscriber = (Subscriber *) user_data;
+  gchar buffer[64];
+  gssize len;
+  gint i;
+
+  len = recv (g_io_channel_unix_get_fd (channel),
+              buffer,
+              sizeof (buffer),
+              MSG_DONTWAIT);
+
+  if (len < 0 && (errno == EAGAIN || errno == EINTR))
+    return TRUE;
+
+  if (len <= 0 || (condition & (G_IO_HUP | G_IO_ERR)))
+    {
+      /* Returning FALSE already removes the watch */
+      subscriber->watch_id = 0;
+      subscriber_free (subscriber);
+      return FALSE;
+    }
+
+  for (i = 0; i < len; i++)
+    {
+      if (buffer[i] == '\n')
+        {
+          subscriber->request[subscriber->request_len] = '\0';
+          subscriber_handle_request (subscriber, subscriber->request);
+          subscriber->request_len = 0;
+        }
+      else if (buffer[i] != '\r' &&
+               subscriber->request_len < sizeof (subscriber->request) - 1)
+        {
+          subscriber->request[subscriber->request_len++] = buffer[i];
+        }
+    }
+
+  return TRUE;
+}
+
+static gboolean
+on_new_connection (GIOChannel *channel,
+                   GIOCondition condition,
+                   gpointer user_data)
+{
+  JointPublisher *publisher = (JointPublisher *) user_data;
+  Subscriber *subscriber;
+  gint fd;
+
+  fd = accept (g_io_channel_unix_get_fd (channel), NULL, NULL);
+  if (fd < 0)
+    return TRUE;
+
+  subscriber = g_slice_new0 (Subscriber);
+  subscriber->publisher = publisher;
+  subscriber->channel = g_io_channel_unix_new (fd);
+  g_io_channel_set_close_on_unref (subscriber->channel, TRUE);
+  subscriber->watch_id = g_io_add_watch (subscriber->channel,
+                                         G_IO_IN | G_IO_HUP | G_IO_ERR,
+                                         on_subscriber_io,
+                                         subscriber);
+
+  publisher->subscribers = g_list_prepend (publisher->subscribers,
+                                           subscriber);
+
+  return TRUE;
+}
+
+static gboolean
+create_control_socket (JointPublisher *publisher, GError **error)
+{
+  struct sockaddr_un address;
+  gint fd;
+
+  if (strlen (publisher->socket_path) >= sizeof (address.sun_path))
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                   "Socket path too long: %s", publisher->socket_path);
+      return FALSE;
+    }
+
+  fd = socket (AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+  if (fd < 0)
+    {
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+                   "Failed to create socket: %s", g_strerror (errno));
+      return FALSE;
+    }
+
+  memset (&address, 0, sizeof (address));
+  address.sun_family = AF_UNIX;
+  strcpy (address.sun_path, publisher->socket_path);
+
+  /* A socket left behind by a previous run would make bind fail */
+  unlink (publisher->socket_path);
+
+  if (bind (fd, (struct sockaddr *) &address, sizeof (address)) != 0 ||
+      listen (fd, 8) != 0)
+    {
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+                   "Failed to listen on %s: %s",
+                   publisher->socket_path, g_strerror (errno));
+      close (fd);
+      return FALSE;
+    }
+
+  publisher->channel = g_io_channel_unix_new (fd);
+  g_io_channel_set_close_on_unref (publisher->channel, TRUE);
+  publisher->watch_id = g_io_add_watch (publisher->channel,
+                                        G_IO_IN,
+                                        on_new_connection,
+                                        publisher);
+
+  return TRUE;
+}
+
+static gboolean
+create_shared_memory (JointPublisher *publisher,
+                      guint max_depth_width,
+                      guint max_depth_height,
+                      GError **error)
+{
+  gsize slot_size;
+  gint fd;
+
+  slot_size = sizeof (JointStreamFrame) +
+    max_depth_width * max_depth_height * sizeof (guint16);
+  slot_size = (slot_size + JOINT_STREAM_SLOT_ALIGNMENT - 1) /
+    JOINT_STREAM_SLOT_ALIGNMENT * JOINT_STREAM_SLOT_ALIGNMENT;
+
+  publisher->shm_name = g_strdup_printf ("/skeltrack-joints-%d", getpid ());
+  publisher->memory_size = JOINT_STREAM_HEADER_SIZE +
+    JOINT_STREAM_RING_SIZE * slot_size;
+
+  fd = shm_open (publisher->shm_name, O_CREAT | O_RDWR | O_TRUNC, 0600);
+  if (fd < 0)
+    {
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+                   "Failed to create shared memory %s: %s",
+                   publisher->shm_name, g_strerror (errno));
+      return FALSE;
+    }
+
+  if (ftruncate (fd, publisher->memory_size) != 0)
+    {
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+                   "Failed to resize shared memory %s: %s",
+                   publisher->shm_name, g_strerror (errno));
+      close (fd);
+      return FALSE;
+    }
+
+  publisher->memory = mmap (NULL, publisher->memory_size,
+                            PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close (fd);
+
+  if (publisher->memory == MAP_FAILED)
+    {
+      publisher->memory = NULL;
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+                   "Failed to map shared memory %s: %s",
+                   publisher->shm_name, g_strerror (errno));
+      return FALSE;
+    }
+
+  /* ftruncate already zeroed the memory */
+  publisher->header = (JointStreamHeader *) publisher->memory;
+  publisher->header->ring_size = JOINT_STREAM_RING_SIZE;
+  publisher->header->slot_size = slot_size;
+  publisher->header->max_depth_width = max_depth_width;
+  publisher->header->max_depth_height = max_depth_height;
+  publisher->header->version = JOINT_STREAM_VERSION;
+  /* Written last, readers check it before anything else */
+  g_atomic_int_set ((volatile gint *) &publisher->header->magic,
+                    JOINT_STREAM_MAGIC);
+
+  return TRUE;
+}
+
+JointPublisher *
+joint_publisher_new (const gchar *socket_path,
+                     guint max_depth_width,
+                     guint max_depth_height,
+                     GError **error)
+{
+  JointPublisher *publisher;
+
+  g_return_val_if_fail (socket_path != NULL, NULL);
+
+  publisher = g_slice_new0 (JointPublisher);
+  publisher->socket_path = g_strdup (socket_path);
+
+  if (! create_shared_memory (publisher,
+                              max_depth_width,
+                              max_depth_height,
+                              error) ||
+      ! create_control_socket (publisher, error))
+    {
+      joint_publisher_free (publisher);
+      return NULL;
+    }
+
+  return publisher;
+}
+
+void
+joint_publisher_free (JointPublisher *publisher)
+{
+  if (publisher == NULL)
+    return;
+
+  while (publisher->subscribers != NULL)
+    subscriber_free ((Subscriber *) publisher->subscribers->data);
+
+  if (publisher->channel != NULL)
+    {
+      g_source_remove (publisher->watch_id);
+      g_io_channel_unref (publisher->channel);
+      unlink (publisher->socket_path);
+    }
+
+  if (publisher->memory != NULL)
+    munmap (publisher->memory, publisher->memory_size);
+  if (publisher->shm_name != NULL)
+    shm_unlink (publisher->shm_name);
+
+  g_free (publisher->shm_name);
+  g_free (publisher->socket_path);
+  g_slice_free (JointPublisher, publisher);
+}
+
+guint
+joint_publisher_get_n_subscribers (JointPublisher *publisher)
+{
+  g_return_val_if_fail (publisher != NULL, 0);
+
+  return publisher->n_subscribers;
+}
+
+/* Writes the joints (and the depth, if there is room for it) to the next
+   slot in the ring. This never waits for the readers; nothing is done at
+   all while there are no subscribers. */
+void
+joint_publisher_publish (JointPublisher *publisher,
+                         SkeltrackJointList list,
+                         gint64 timestamp,
+                         guint16 *depth,
+                         guint depth_width,
+                         guint depth_height)
+{
+  JointStreamFrame *slot;
+  gint i;
+
+  g_return_if_fail (publisher != NULL);
+
+  if (publisher->n_subscribers == 0)
+    return;
+
+  slot = (JointStreamFrame *)
+    (publisher->memory + JOINT_STREAM_HEADER_SIZE +
+     (gsize) (publisher->frame_count % JOINT_STREAM_RING_SIZE) *
+     publisher->header->slot_size);
+
+  /* Odd sequence: slot being written */
+  g_atomic_int_inc (&slot->sequence);
+
+  slot->frame_number = publisher->frame_count + 1;
+  slot->timestamp = timestamp;
+
+  for (i = 0; i < JOINT_STREAM_MAX_JOINTS; i++)
+    {
+      SkeltrackJoint *joint = NULL;
+
+      if (list != NULL)
+        joint = skeltrack_joint_list_get_joint (list, i);
+
+      if (joint == NULL)
+        {
+          slot->joints[i].id = -1;
+          continue;
+        }
+
+      slot->joints[i].id = joint->id;
+      slot->joints[i].x = joint->x;
+      slot->joints[i].y = joint->y;
+      slot->joints[i].z = joint->z;
+      slot->joints[i].screen_x = joint->screen_x;
+      slot->joints[i].screen_y = joint->screen_y;
+    }
+
+  if (depth != NULL &&
+      depth_width <= publisher->header->max_depth_width &&
+      depth_height <= publisher->header->max_depth_height)
+    {
+      slot->depth_width = depth_width;
+      slot->depth_height = depth_height;
+      memcpy (slot + 1, depth, depth_width * depth_height * sizeof (guint16));
+    }
+  else
+    {
+      slot->depth_width = 0;
+      slot->depth_height = 0;
+    }
+
+  /* Even again: slot complete */
+  g_atomic_int_inc (&slot->sequence);
+
+  publisher->frame_count++;
+  g_atomic_int_set (&publisher->header->frame_count,
+                    (gint) publisher->frame_count);
+}
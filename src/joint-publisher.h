@@ -0,0 +1,44 @@
+/* Skeltrack Desktop Control: Joint Publisher
+ *
+ * Copyright (c) 2012 Igalia, S.L.
+ *
+ * Author: Joaquim Rocha <jrocha@igalia.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __JOINT_PUBLISHER_H__
+#define __JOINT_PUBLISHER_H__
+
+#include <skeltrack.h>
+
+typedef struct _JointPublisher JointPublisher;
+
+JointPublisher * joint_publisher_new     (const gchar *socket_path,
+                                          guint        max_depth_width,
+                                          guint        max_depth_height,
+                                          GError     **error);
+
+void             joint_publisher_free    (JointPublisher *publisher);
+
+void             joint_publisher_publish (JointPublisher    *publisher,
+                                          SkeltrackJointList list,
+                                          gint64             timestamp,
+                                          guint16           *depth,
+                                          guint              depth_width,
+                                          guint              depth_height);
+
+guint            joint_publisher_get_n_subscribers (JointPublisher *publisher);
+
+#endif /* __JOINT_PUBLISHER_H__ */
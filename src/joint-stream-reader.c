@@ -0,0 +1,317 @@
+/* Skeltrack Desktop Control: Joint Stream Reader
+ *
+ * Copyright (c) 2012 Igalia, S.L.
+ *
+ * Author: Joaquim Rocha <jrocha@igalia.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "joint-stream.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <gio/gio.h>
+
+/* Times a read is retried when the publisher keeps
+   overwriting the slot being read */
+#define MAX_READ_RETRIES 4
+
+struct _JointStreamReader
+{
+  gint socket_fd;
+  guchar *memory;
+  gsize memory_size;
+  JointStreamHeader *header;
+  guint32 last_frame_number;
+};
+
+static gboolean
+read_reply (gint fd, gchar *reply, gsize size, GError **error)
+{
+  gsize len = 0;
+
+  while (len < size - 1)
+    {
+      gssize n = read (fd, reply + len, 1);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        {
+          g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                               "Joint stream publisher closed the connection");
+          return FALSE;
+        }
+      if (reply[len] == '\n')
+        break;
+      len++;
+    }
+  reply[len] = '\0';
+
+  return TRUE;
+}
+
+static gboolean
+subscribe (JointStreamReader *reader,
+           const gchar *socket_path,
+           gchar *shm_name,
+           gsize shm_name_size,
+           GError **error)
+{
+  struct sockaddr_un address;
+  const gchar *request = "SUBSCRIBE\n";
+  gchar reply[128];
+
+  if (strlen (socket_path) >= sizeof (address.sun_path))
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                   "Socket path too long: %s", socket_path);
+      return FALSE;
+    }
+
+  reader->socket_fd = socket (AF_UNIX, SOCK_STREAM, 0);
+  if (reader->socket_fd < 0)
+    {
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+                   "Failed to create socket: %s", g_strerror (errno));
+      return FALSE;
+    }
+
+  memset (&address, 0, sizeof (address));
+  address.sun_family = AF_UNIX;
+  strcpy (address.sun_path, socket_path);
+
+  if (connect (reader->socket_fd,
+               (struct sockaddr *) &address,
+               sizeof (address)) != 0)
+    {
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+                   "Failed to connect to %s: %s",
+                   socket_path, g_strerror (errno));
+      return FALSE;
+    }
+
+  if (write (reader->socket_fd, request, strlen (request)) !=
+      (gssize) strlen (request))
+    {
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+                   "Failed to subscribe: %s", g_strerror (errno));
+      return FALSE;
+    }
+
+  if (! read_reply (reader->socket_fd, reply, sizeof (reply), error))
+    return FALSE;
+
+  if (! g_str_has_prefix (reply, "OK /") ||
+      strlen (reply + 3) >= shm_name_size)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "Unexpected reply from joint stream publisher: %s", reply);
+      return FALSE;
+    }
+  strcpy (shm_name, reply + 3);
+
+  return TRUE;
+}
+
+static gboolean
+map_memory (JointStreamReader *reader,
+            const gchar *shm_name,
+            GError **error)
+{
+  struct stat info;
+  gint fd;
+
+  fd = shm_open (shm_name, O_RDONLY, 0);
+  if (fd < 0)
+    {
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+                   "Failed to open shared memory %s: %s",
+                   shm_name, g_strerror (errno));
+      return FALSE;
+    }
+
+  if (fstat (fd, &info) != 0 || info.st_size < JOINT_STREAM_HEADER_SIZE)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "Shared memory %s is too small", shm_name);
+      close (fd);
+      return FALSE;
+    }
+
+  reader->memory_size = info.st_size;
+  reader->memory = mmap (NULL, reader->memory_size,
+                         PROT_READ, MAP_SHARED, fd, 0);
+  close (fd);
+
+  if (reader->memory == MAP_FAILED)
+    {
+      reader->memory = NULL;
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+                   "Failed to map shared memory %s: %s",
+                   shm_name, g_strerror (errno));
+      return FALSE;
+    }
+
+  reader->header = (JointStreamHeader *) reader->memory;
+  if (reader->header->magic != JOINT_STREAM_MAGIC ||
+      reader->header->version != JOINT_STREAM_VERSION ||
+      reader->header->ring_size == 0 ||
+      JOINT_STREAM_HEADER_SIZE + (gsize) reader->header->ring_size *
+      reader->header->slot_size > reader->memory_size)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "Shared memory %s is not a joint stream "
+                   "this reader understands", shm_name);
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+JointStreamReader *
+joint_stream_reader_open (const gchar *socket_path, GError **error)
+{
+  JointStreamReader *reader;
+  gchar shm_name[NAME_MAX];
+
+  g_return_val_if_fail (socket_path != NULL, NULL);
+
+  reader = g_slice_new0 (JointStreamReader);
+  reader->socket_fd = -1;
+
+  if (! subscribe (reader, socket_path, shm_name, sizeof (shm_name), error) ||
+      ! map_memory (reader, shm_name, error))
+    {
+      joint_stream_reader_close (reader);
+      return NULL;
+    }
+
+  return reader;
+}
+
+void
+joint_stream_reader_close (JointStreamReader *reader)
+{
+  if (reader == NULL)
+    return;
+
+  if (reader->memory != NULL)
+    munmap (reader->memory, reader->memory_size);
+
+  /* Closing the connection is what unsubscribes */
+  if (reader->socket_fd >= 0)
+    close (reader->socket_fd);
+
+  g_slice_free (JointStreamReader, reader);
+}
+
+const JointStreamHeader *
+joint_stream_reader_get_header (JointStreamReader *reader)
+{
+  g_return_val_if_fail (reader != NULL, NULL);
+
+  return reader->header;
+}
+
+/* Gives direct access to the newest frame in the shared memory, without
+   copying it. Returns FALSE if there is no frame newer than the last one
+   peeked. The frame can be overwritten at any moment, so the data read
+   from it is only good if joint_stream_reader_validate returns TRUE
+   after it has been read. */
+gboolean
+joint_stream_reader_peek (JointStreamReader *reader,
+                          const JointStreamFrame **frame,
+                          gint *sequence)
+{
+  const JointStreamFrame *slot;
+  guint32 count;
+
+  g_return_val_if_fail (reader != NULL, FALSE);
+
+  count = (guint32) g_atomic_int_get (&reader->header->frame_count);
+  if (count == 0 || count == reader->last_frame_number)
+    return FALSE;
+
+  slot = (const JointStreamFrame *)
+    (reader->memory + JOINT_STREAM_HEADER_SIZE +
+     (gsize) ((count - 1) % reader->header->ring_size) *
+     reader->header->slot_size);
+
+  *sequence = g_atomic_int_get (&slot->sequence);
+  if (*sequence % 2 != 0)
+    return FALSE;
+
+  reader->last_frame_number = count;
+  *frame = slot;
+
+  return TRUE;
+}
+
+gboolean
+joint_stream_reader_validate (JointStreamReader *reader,
+                              const JointStreamFrame *frame,
+                              gint sequence)
+{
+  g_return_val_if_fail (reader != NULL && frame != NULL, FALSE);
+
+  /* The slot was read with plain loads, which must not be moved after
+     the sequence is read again */
+  __atomic_thread_fence (__ATOMIC_ACQUIRE);
+
+  return g_atomic_int_get (&frame->sequence) == sequence;
+}
+
+/* Copies the joints of the newest frame (not its depth). Returns FALSE if
+   there is no new frame or if it could not be read consistently. */
+gboolean
+joint_stream_reader_read (JointStreamReader *reader,
+                          JointStreamFrame *frame)
+{
+  gint i;
+
+  g_return_val_if_fail (reader != NULL && frame != NULL, FALSE);
+
+  for (i = 0; i < MAX_READ_RETRIES; i++)
+    {
+      const JointStreamFrame *slot;
+      gint sequence;
+
+      if (! joint_stream_reader_peek (reader, &slot, &sequence))
+        return FALSE;
+
+      memcpy (frame, slot, sizeof (JointStreamFrame));
+
+      if (joint_stream_reader_validate (reader, slot, sequence))
+        {
+          /* The depth stays in the slot, so it cannot be reached
+             through the copy */
+          frame->depth_width = 0;
+          frame->depth_height = 0;
+          return TRUE;
+        }
+
+      /* Let the next peek look at whatever is the newest frame now */
+      reader->last_frame_number--;
+    }
+
+  return FALSE;
+}
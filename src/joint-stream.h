@@ -0,0 +1,125 @@
+/* Skeltrack Desktop Control: Joint Stream
+ *
+ * Copyright (c) 2012 Igalia, S.L.
+ *
+ * Author: Joaquim Rocha <jrocha@igalia.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* The joint stream lets other local programs read the skeleton tracked
+   by Skeltrack Desktop Control without opening the sensor themselves.
+
+   Frames are written into a ring of slots in POSIX shared memory. Each
+   slot is guarded by a sequence counter (a seqlock): the publisher makes
+   it odd before writing the slot and even again when done, so readers
+   never block the publisher, they just retry if the counter changed while
+   they were reading.
+
+   Consumers find the shared memory through a Unix socket: they connect,
+   send "SUBSCRIBE" and get back a line "OK <shm-name>". The subscription
+   lasts as long as the connection is open; while nobody is subscribed the
+   publisher does not write anything. */
+
+#ifndef __JOINT_STREAM_H__
+#define __JOINT_STREAM_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+#define JOINT_STREAM_MAGIC      0x534b4a53 /* "SKJS" */
+#define JOINT_STREAM_VERSION    1
+#define JOINT_STREAM_RING_SIZE  8
+#define JOINT_STREAM_MAX_JOINTS 7
+
+/* Same numbering as SkeltrackJointId, -1 for joints not found */
+typedef struct
+{
+  gint32 id;
+  gint32 x;
+  gint32 y;
+  gint32 z;
+  gint32 screen_x;
+  gint32 screen_y;
+} JointStreamJoint;
+
+typedef struct
+{
+  /* Odd while the publisher is writing the slot */
+  volatile gint sequence;
+  guint32 frame_number;
+  /* Monotonic time (g_get_monotonic_time) of the depth frame */
+  gint64 timestamp;
+  JointStreamJoint joints[JOINT_STREAM_MAX_JOINTS];
+  /* Size of the reduced depth frame following this header,
+     0x0 when the publisher does not share depth */
+  guint32 depth_width;
+  guint32 depth_height;
+} JointStreamFrame;
+
+typedef struct
+{
+  guint32 magic;
+  guint32 version;
+  guint32 ring_size;
+  /* Bytes from the start of one slot to the next one */
+  guint32 slot_size;
+  guint32 max_depth_width;
+  guint32 max_depth_height;
+  /* Number of frames published so far; the newest one
+     is in slot (frame_count - 1) % ring_size */
+  volatile gint frame_count;
+  guint32 padding;
+} JointStreamHeader;
+
+/* Slots start at this offset in the shared memory and are aligned to it */
+#define JOINT_STREAM_SLOT_ALIGNMENT 64
+#define JOINT_STREAM_HEADER_SIZE JOINT_STREAM_SLOT_ALIGNMENT
+
+G_STATIC_ASSERT (sizeof (JointStreamHeader) <= JOINT_STREAM_HEADER_SIZE);
+
+/* The depth follows the frame in its slot: only frames given by
+   joint_stream_reader_peek have one, copies return NULL */
+static inline const guint16 *
+joint_stream_frame_get_depth (const JointStreamFrame *frame)
+{
+  if (frame->depth_width == 0 || frame->depth_height == 0)
+    return NULL;
+  return (const guint16 *) (frame + 1);
+}
+
+typedef struct _JointStreamReader JointStreamReader;
+
+JointStreamReader *      joint_stream_reader_open       (const gchar *socket_path,
+                                                         GError     **error);
+
+void                     joint_stream_reader_close      (JointStreamReader *reader);
+
+const JointStreamHeader *joint_stream_reader_get_header (JointStreamReader *reader);
+
+gboolean                 joint_stream_reader_peek       (JointStreamReader       *reader,
+                                                         const JointStreamFrame **frame,
+                                                         gint                    *sequence);
+
+gboolean                 joint_stream_reader_validate   (JointStreamReader      *reader,
+                                                         const JointStreamFrame *frame,
+                                                         gint                    sequence);
+
+gboolean                 joint_stream_reader_read       (JointStreamReader *reader,
+                                                         JointStreamFrame  *frame);
+
+G_END_DECLS
+
+#endif /* __JOINT_STREAM_H__ */
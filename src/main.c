@@ -21,430 +21,212 @@
 #include <gfreenect.h>
 #include <skeltrack.h>
 #include <math.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/resource.h>
 #include <glib-object.h>
 #include <clutter/clutter.h>
 #include <clutter/clutter-keysyms.h>
 #include <X11/Xlib.h>
-#include <X11/keysym.h>
-#include <X11/extensions/XTest.h>
+
+#include "alloc-counter.h"
+#include "batch.h"
+#include "depth-codec.h"
+#include "depth-pyramid.h"
+#include "depth-recording.h"
+#include "depth-window.h"
+#include "dtw-recognizer.h"
+#include "gestures.h"
+#include "input-event.h"
+#include "joint-exchange.h"
+#include "joint-publisher.h"
+#include "motion-detector.h"
+#include "realtime.h"
+#include "synthetic-scene.h"
 
 static SkeltrackSkeleton *skeleton = NULL;
 static GFreenectDevice *kinect = NULL;
 static ClutterActor *info_text;
 static ClutterActor *depth_tex;
-static SkeltrackJointList list = NULL;
+/* The latest joints, for the view */
+static JointExchange *view_joints = NULL;
 static gboolean SHOW_SKELETON = TRUE;
 
 static Display *display = NULL;
 static gint screen_width = 0;
 static gint screen_height = 0;
 
-/* In the Z axis, from the head*/
-static gint GESTURE_THRESHOLD = 250;
-
-/* Timeout after a hand gets ready to be interpreted
-   and it actually is. In milliseconds. */
-static guint GESTURE_TIMEOUT = 300;
-
 static guint THRESHOLD_BEGIN = 500;
 /* Adjust this value to increase of decrease
    the threshold */
 static guint THRESHOLD_END   = 1500;
+/* Whether the threshold follows the user, until changed by hand */
+static gboolean AUTO_THRESHOLD = TRUE;
+/* It stays around the head while it was seen in the last this many ms,
+   and otherwise searches for the nearest body */
+static guint AUTO_THRESHOLD_TRACKED_MS = 1000;
+static DepthWindow *depth_window = NULL;
+static gint64 last_head_time = 0;
+static guint last_head_z = 0;
+
+static GestureState *gestures = NULL;
+/* Start in grab mode, which C toggles */
+static gboolean GRAB_MODE = FALSE;
+
+static DtwRecognizer *recognizer = NULL;
+static gchar *TEMPLATES_FILE = NULL;
+
+static JointPublisher *publisher = NULL;
+static gchar *PUBLISH_SOCKET = NULL;
+static gboolean PUBLISH_DEPTH = FALSE;
+
+static DepthRecorder *recorder = NULL;
+static DepthPlayer *player = NULL;
+static guint replay_index = 0;
+static gchar *RECORD_FILE = NULL;
+static gchar *REPLAY_FILE = NULL;
+
+static SyntheticScene *scene = NULL;
+static guint16 *synthetic_buffer = NULL;
+static guint synthetic_frame = 0;
+static guint synthetic_width = 640;
+static guint synthetic_height = 480;
+static gchar *SYNTHETIC_SCRIPT = NULL;
+static gchar *SYNTHETIC_SIZES = NULL;
+static gchar *DIMENSION_REDUCTIONS = NULL;
+static gboolean BENCHMARK = FALSE;
+static gchar *BATCH_FILE = NULL;
+
+/* Seconds without anyone tracked before going idle; 0 never does */
+static gint IDLE_TIMEOUT = 5;
+/* While idle, every frame is looked at, but only one in this many
+   pixels in each direction */
+static guint IDLE_DECIMATION = 16;
+static MotionDetector *motion = NULL;
+static gboolean idle = FALSE;
+static gint64 last_tracked_time = 0;
+static gint64 idle_start_time = 0;
+static struct rusage idle_start_usage;
+
+static gchar *REALTIME_CPUS = NULL;
+static gboolean REALTIME = FALSE;
+static gint REALTIME_PRIORITY = 10;
+static gboolean REPORT_JITTER = FALSE;
+/* Frames between reports of the jitter, 10 s of the Kinect's stream */
+static guint JITTER_REPORT_FRAMES = 300;
+static RealtimeJitter *jitter = NULL;
+
+static GOptionEntry entries[] =
+{
+  { "record", 'r', 0, G_OPTION_ARG_FILENAME, &RECORD_FILE,
+    "Record the Kinect's depth stream to FILE", "FILE" },
+  { "replay", 0, 0, G_OPTION_ARG_FILENAME, &REPLAY_FILE,
+    "Use a recording made with --record instead of the Kinect", "FILE" },
+  { "synthetic", 's', 0, G_OPTION_ARG_FILENAME, &SYNTHETIC_SCRIPT,
+    "Use a person rendered as told by SCRIPT instead of the Kinect",
+    "SCRIPT" },
+  { "synthetic-size", 0, 0, G_OPTION_ARG_STRING, &SYNTHETIC_SIZES,
+    "Size of the synthetic frames, a comma separated list "
+    "for --benchmark (default: 640x480)", "WIDTHxHEIGHT" },
+  { "dimension-reduction", 0, 0, G_OPTION_ARG_STRING, &DIMENSION_REDUCTIONS,
+    "Skeltrack's dimension reduction, a comma separated list "
+    "for --benchmark", "FACTOR" },
+  { "benchmark", 'b', 0, G_OPTION_ARG_NONE, &BENCHMARK,
+    "Run the synthetic script as fast as possible without a desktop, "
+    "time it and check the events it expects", NULL },
+  { "batch", 0, 0, G_OPTION_ARG_FILENAME, &BATCH_FILE,
+    "Run the recordings in FILE with each set of parameters in it, "
+    "on all the CPUs and without a desktop", "FILE" },
+  { "grab", 0, 0, G_OPTION_ARG_NONE, &GRAB_MODE,
+    "Start in grab mode: closing the hand moving the pointer presses "
+    "the button and opening it releases it", NULL },
+  { "templates", 't', 0, G_OPTION_ARG_FILENAME, &TEMPLATES_FILE,
+    "Recognize the hand movements recorded in FILE", "FILE" },
+  { "publish", 'p', 0, G_OPTION_ARG_FILENAME, &PUBLISH_SOCKET,
+    "Share the tracked joints with other programs through the "
+    "Unix socket PATH", "PATH" },
+  { "publish-depth", 0, 0, G_OPTION_ARG_NONE, &PUBLISH_DEPTH,
+    "Also share the reduced depth frame given to Skeltrack", NULL },
+  { "idle-timeout", 0, 0, G_OPTION_ARG_INT, &IDLE_TIMEOUT,
+    "Stop tracking after nobody was seen for SECONDS until something "
+    "moves (default: 5, 0 to always track)", "SECONDS" },
+  { "cpus", 0, 0, G_OPTION_ARG_STRING, &REALTIME_CPUS,
+    "Only run on the CPUs in LIST, e.g. 2,3 or 2-3", "LIST" },
+  { "realtime", 0, 0, G_OPTION_ARG_NONE, &REALTIME,
+    "Track with a real-time priority and locked memory; "
+    "also reports the jitter", NULL },
+  { "realtime-priority", 0, 0, G_OPTION_ARG_INT, &REALTIME_PRIORITY,
+    "SCHED_FIFO priority used by --realtime (default: 10)", "PRIORITY" },
+  { "jitter", 0, 0, G_OPTION_ARG_NONE, &REPORT_JITTER,
+    "Periodically report how late the frames arrive", NULL },
+  { NULL }
+};
 
-static ClutterEventType pointer_1_event_type = CLUTTER_NOTHING;
-static ClutterEventType pointer_2_event_type = CLUTTER_NOTHING;
-
-/* Affect how two hands gestures should be interpreted */
-static gboolean DOUBLE_HAND_WHEEL_MODE = TRUE;
-
-/* Distance between the two points (in 640x480)
-   so that it should be considered as "steering wheel
-   turned" gesture */
-static guint WHEEL_TURN_ACTIVATE_DISTANCE = 35;
-
-/* Distance between the two points (in 640x480)
-   so that it should be considered a pinch gesture */
-static guint PINCH_ACTIVATE_DISTANCE = 75;
-
-typedef struct _Point Point;
-
-static Point *pointer_1 = NULL;
-static Point *pointer_2 = NULL;
-static Point *last_left_point = NULL;
-static Point *last_right_point = NULL;
-static gint64 pointer_enter_time = 0;
-static gint old_distance = -1;
-static guint last_key = 0;
+static DepthPyramidPool *pyramids = NULL;
 
 typedef struct
 {
+  DepthPyramid *pyramid;
+  /* Levels of the pyramid: Skeltrack's and the full size one */
   guint16 *reduced_buffer;
   guint16 *original_buffer;
   gint width;
   gint height;
   gint reduced_width;
   gint reduced_height;
+  gint64 timestamp;
 } BufferInfo;
 
-struct _Point
-{
-  gint x;
-  gint y;
-  gint z;
-};
-
-static Point *
-smooth_point (guint16 *buffer,
-              guint width,
-              guint height,
-              SkeltrackJoint *joint);
-
-static gint
-get_distance (Point *point_a, Point *point_b)
-{
-  gint dx, dy;
-  dx = ABS (point_a->x - point_b->x);
-  dy = ABS (point_a->y - point_b->y);
-  return sqrt (dx * dx + dy * dy);
-}
-
 static void
-get_pointer_position (Display *display, gint *x, gint *y)
+recognize_templates (SkeltrackJointList joint_list)
 {
-  XEvent e;
-  Window root;
-  root = XRootWindow(display, 0);
-  XQueryPointer(display, root,
-                &e.xbutton.root, &e.xbutton.window,
-                &e.xbutton.x_root, &e.xbutton.y_root,
-                &e.xbutton.x, &e.xbutton.y,
-                &e.xbutton.state);
-  *x = e.xbutton.x_root;
-  *y = e.xbutton.y_root;
-}
+  DtwMatch match;
 
-static void
-set_mouse_pointer (gint x, gint y)
-{
-  gint pos_x, pos_y;
-  gdouble rel_x, rel_y;
-  if (display == NULL)
+  if (! dtw_recognizer_feed (recognizer, joint_list, &match))
     return;
 
-  get_pointer_position (display, &pos_x, &pos_y);
-
-  rel_x = screen_width - (x * screen_width / 640.f * 1.1);
-  rel_y = y * screen_height / 480.f * 1.1;
-
-  pos_x += round ((rel_x - pos_x) / 8.f);
-  pos_y += round ((rel_y - pos_y) / 8.f);
-
-  XTestFakeMotionEvent(display, -1, pos_x, pos_y, CurrentTime);
-  XSync(display, 0);
-}
-
-static void
-key_down (guint keycode)
-{
-  XTestFakeKeyEvent (display,
-                     keycode,
-                     TRUE,
-                     CurrentTime);
-  XSync(display, 0);
-}
-
-static void
-key_up (guint keycode)
-{
-  XTestFakeKeyEvent (display,
-                     keycode,
-                     FALSE,
-                     CurrentTime);
-  XSync(display, 0);
+  g_debug ("Recognized %s (%.3f m)", match.name, match.distance);
+  if (match.action->type == DTW_ACTION_KEYS)
+    gesture_state_send_keys (gestures,
+                             match.action->codes,
+                             match.action->n_codes);
+  else
+    gesture_state_click (gestures, match.action->codes[0]);
 }
 
+/* Remembers where the head was, for the threshold to follow it */
 static void
-mouse_down (guint button)
+see_head (SkeltrackJointList joint_list, gint64 timestamp)
 {
-  XTestFakeButtonEvent(display, button, TRUE, CurrentTime);
-  XSync(display, 0);
-}
+  SkeltrackJoint *head;
 
-static void
-mouse_up (guint button)
-{
-  XTestFakeButtonEvent(display, button, FALSE, CurrentTime);
-  XSync(display, 0);
-}
+  head = skeltrack_joint_list_get_joint (joint_list, SKELTRACK_JOINT_ID_HEAD);
+  if (head == NULL || head->z <= 0)
+    return;
 
-static void
-mouse_click (guint button)
-{
-  XTestFakeButtonEvent(display, button, TRUE, CurrentTime);
-  XTestFakeButtonEvent(display, button, FALSE, CurrentTime);
-  XSync(display, 0);
+  last_head_time = timestamp;
+  last_head_z = head->z;
 }
 
+/* Moves the threshold to the user for the next frames; returns whether
+   it changed */
 static gboolean
-hand_is_active (SkeltrackJoint *head, SkeltrackJoint *hand)
-{
-  return hand != NULL && ABS (head->z - hand->z) > GESTURE_THRESHOLD;
-}
-
-static void
-both_hands_left (void)
-{
-  XTestFakeButtonEvent(display, 1, FALSE, CurrentTime);
-  XSync(display, 0);
-  pointer_1 = NULL;
-  pointer_2 = NULL;
-  pointer_1_event_type = CLUTTER_NOTHING;
-  pointer_2_event_type = CLUTTER_NOTHING;
-  old_distance = -1;
-
-  if (last_key != 0)
-    {
-      guint keycode;
-      XTestFakeKeyEvent (display,
-                         last_key,
-                         FALSE,
-                         CurrentTime);
-      keycode = XKeysymToKeycode(display, XK_Up);
-      XTestFakeKeyEvent (display,
-                         keycode,
-                         FALSE,
-                         CurrentTime);
-      XSync(display, 0);
-      last_key = 0;
-    }
-}
-
-static void
-interpret_wheel_gesture (Point *pointer_1,
-                         Point *pointer_2)
+follow_user (BufferInfo *buffer_info)
 {
-  /* Assuming pointer_1 is the left hand
-     and pointer_2 is the right hand */
-  guint keycode;
-
-  if (pointer_1->y < pointer_2->y)
-    {
-      keycode = XKeysymToKeycode(display, XK_Right);
-      g_debug ("RIGHT");
-    }
-  else
-    {
-      keycode = XKeysymToKeycode(display, XK_Left);
-      g_debug ("LEFT");
-    }
-
-  if (last_key != 0 && keycode != last_key)
-    {
-      key_up (last_key);
-    }
-  if (ABS (pointer_1->y - pointer_2->y) / WHEEL_TURN_ACTIVATE_DISTANCE != 0)
-    {
-      key_down (keycode);
-    }
-  else
-    {
-      key_up (keycode);
-    }
-  keycode = XKeysymToKeycode(display, XK_Up);
-  key_down (keycode);
-  last_key = keycode;
-}
-
-static void
-interpret_pinch_gesture (Point *pointer_1,
-                         Point *pointer_2)
-{
-  if (old_distance == -1)
-    {
-      old_distance = get_distance (pointer_1, pointer_2);
-    }
-  else
-    {
-      gint new_distance = get_distance (pointer_1, pointer_2);
-      if (ABS (old_distance - new_distance) > PINCH_ACTIVATE_DISTANCE)
-        {
-          g_debug ("ENTERED");
-          guint keycode;
-          keycode = XKeysymToKeycode(display, XK_Control_L);
-          key_down (keycode);
-          if (old_distance < new_distance)
-            {
-              mouse_click (4);
-              g_debug ("SCROLL UP!");
-            }
-          else
-            {
-              mouse_click (5);
-              g_debug ("SCROLL DOWN!");
-            }
-          key_up (keycode);
-          old_distance = new_distance;
-        }
-    }
-}
-
-static void
-interpret_guestures (SkeltrackJointList joint_list,
-                     guint16 *buffer,
-                     guint width,
-                     guint height)
-{
-  gint64 time;
-  Point *left_point, *right_point, *single_point;
-  SkeltrackJoint *head, *left_hand, *right_hand;
-
-  if (joint_list == NULL)
-    return;
-
-  head = skeltrack_joint_list_get_joint (joint_list,
-                                         SKELTRACK_JOINT_ID_HEAD);
-  left_hand = skeltrack_joint_list_get_joint (joint_list,
-                                              SKELTRACK_JOINT_ID_LEFT_HAND);
-  right_hand = skeltrack_joint_list_get_joint (joint_list,
-                                               SKELTRACK_JOINT_ID_RIGHT_HAND);
-
-  if (head == NULL)
-    return;
-
-  left_point = NULL;
-  right_point = NULL;
-  single_point = NULL;
-
-  if (hand_is_active (head, left_hand))
-    {
-      left_point = smooth_point (buffer, width, height, left_hand);
-      single_point = left_point;
-      if (hand_is_active (head, right_hand))
-        {
-          right_point = smooth_point (buffer, width, height, right_hand);
-          single_point = NULL;
-        }
-    }
-  else if (hand_is_active (head, right_hand))
-    {
-      right_point = smooth_point (buffer, width, height, right_hand);
-      single_point = right_point;
-    }
-
-  if (single_point)
-    {
-      if (last_key != 0)
-        {
-          key_up (last_key);
-          last_key = 0;
-        }
-
-      if (pointer_1_event_type == CLUTTER_SCROLL)
-        {
-          pointer_1_event_type = CLUTTER_NOTHING;
-        }
-      else if (pointer_2_event_type == CLUTTER_BUTTON_PRESS)
-        {
-          mouse_up (1);
-        }
-      else if (pointer_2_event_type == CLUTTER_ENTER)
-        {
-          mouse_click (1);
-          pointer_2_event_type = CLUTTER_NOTHING;
-        }
-
-      time = g_get_real_time ();
-      if (pointer_1_event_type == CLUTTER_NOTHING)
-        {
-          pointer_enter_time = time;
-          pointer_1_event_type = CLUTTER_ENTER;
-        }
-      else if (pointer_1_event_type == CLUTTER_MOTION ||
-               (pointer_1_event_type == CLUTTER_ENTER &&
-                time - pointer_enter_time > GESTURE_TIMEOUT * 1000))
-        {
-          pointer_1_event_type = CLUTTER_MOTION;
-          pointer_2_event_type = CLUTTER_NOTHING;
-          pointer_1 = single_point;
-          set_mouse_pointer (single_point->x, single_point->y);
-        }
-    }
-  else if (left_point && right_point)
-    {
-      time = g_get_real_time ();
-      if (pointer_1_event_type == CLUTTER_MOTION)
-        {
-          /* One hand entered when the other was already
-             doing something */
-          Point *point = NULL;
-
-          if (pointer_2_event_type == CLUTTER_NOTHING)
-            {
-              pointer_enter_time = time;
-              pointer_2_event_type = CLUTTER_ENTER;
-            }
-          else if (pointer_2_event_type == CLUTTER_ENTER &&
-                   time - pointer_enter_time > GESTURE_TIMEOUT * 1000)
-            {
-              pointer_2_event_type = CLUTTER_BUTTON_PRESS;
-              mouse_down (1);
-            }
-
-          if (pointer_1 == last_left_point)
-            {
-              point = left_point;
-            }
-          else if (pointer_1 == last_right_point)
-            {
-              point = right_point;
-            }
-
-          pointer_1 = point;
-          if (point != NULL)
-            {
-              set_mouse_pointer (point->x, point->y);
-            }
-        }
-      else
-        {
-          /* Both hands entered at the same time*/
-          pointer_1 = left_point;
-          pointer_2 = right_point;
-          pointer_1_event_type = CLUTTER_SCROLL;
-          pointer_2_event_type = CLUTTER_SCROLL;
-
-          /* Skip the first time where both hands entered */
-          if (last_left_point != NULL && last_right_point != NULL)
-            {
-              if (DOUBLE_HAND_WHEEL_MODE)
-                {
-                  interpret_wheel_gesture (pointer_1,
-                                           pointer_2);
-                }
-              else
-                {
-                  interpret_pinch_gesture (pointer_1,
-                                           pointer_2);
-                }
-            }
-        }
-    }
-  else if (last_right_point || last_left_point)
-    {
-      both_hands_left ();
-    }
-
-  if (last_left_point != NULL)
-    {
-      g_slice_free (Point, last_left_point);
-    }
-  last_left_point = left_point;
-  if (last_right_point != NULL)
-    {
-      g_slice_free (Point, last_right_point);
-    }
-  last_right_point = right_point;
+  guint head_z = 0;
+
+  if (last_head_time != 0 &&
+      buffer_info->timestamp - last_head_time <
+      (gint64) AUTO_THRESHOLD_TRACKED_MS * 1000)
+    head_z = last_head_z;
+
+  return depth_window_update (depth_window,
+                              depth_pyramid_get_histogram (buffer_info->pyramid),
+                              DEPTH_PYRAMID_HISTOGRAM_BINS,
+                              DEPTH_PYRAMID_HISTOGRAM_BIN_SIZE,
+                              head_z,
+                              &THRESHOLD_BEGIN,
+                              &THRESHOLD_END);
 }
 
 static void
@@ -453,6 +235,7 @@ on_track_joints (GObject      *obj,
                  gpointer      user_data)
 {
   BufferInfo *buffer_info;
+  SkeltrackJointList list;
   guint16 *reduced, *original;
   gint width, height;
   GError *error = NULL;
@@ -469,7 +252,32 @@ on_track_joints (GObject      *obj,
 
   if (error == NULL)
     {
-      interpret_guestures (list, original, width, height);
+      if (list != NULL &&
+          skeltrack_joint_list_get_joint (list,
+                                          SKELTRACK_JOINT_ID_HEAD) != NULL)
+        {
+          last_tracked_time = buffer_info->timestamp;
+          see_head (list, buffer_info->timestamp);
+        }
+
+      gesture_state_interpret (gestures,
+                               list,
+                               original,
+                               width,
+                               height,
+                               buffer_info->timestamp);
+      recognize_templates (list);
+
+      if (publisher != NULL)
+        joint_publisher_publish (publisher,
+                                 list,
+                                 buffer_info->timestamp,
+                                 PUBLISH_DEPTH ? reduced : NULL,
+                                 buffer_info->reduced_width,
+                                 buffer_info->reduced_height);
+
+      /* From here on, the list belongs to the view */
+      joint_exchange_publish (view_joints, list);
 
       if (SHOW_SKELETON)
         clutter_cairo_texture_invalidate (CLUTTER_CAIRO_TEXTURE (depth_tex));
@@ -479,7 +287,7 @@ on_track_joints (GObject      *obj,
       g_error_free (error);
     }
 
-  g_slice_free1 (width * height * sizeof (guint16), reduced);
+  depth_pyramid_release (buffer_info->pyramid);
   g_slice_free (BufferInfo, buffer_info);
 }
 
@@ -500,71 +308,55 @@ process_buffer (guint16 *buffer,
                 guint threshold_end)
 {
   BufferInfo *buffer_info;
-  gint i, j, reduced_width, reduced_height;
-  guint16 *reduced_buffer;
+  DepthPyramid *pyramid;
+  const DepthLevel *reduced;
 
   g_return_val_if_fail (buffer != NULL, NULL);
 
-  reduced_width = (width - width % dimension_factor) / dimension_factor;
-  reduced_height = (height - height % dimension_factor) / dimension_factor;
-
-  reduced_buffer = g_slice_alloc0 (reduced_width * reduced_height *
-                                   sizeof (guint16));
-
-  for (i = 0; i < reduced_width; i++)
-    {
-      for (j = 0; j < reduced_height; j++)
-        {
-          gint index;
-          guint16 value = 0;
-
-          index = j * width * dimension_factor + i * dimension_factor;
-          value = buffer[index];
-
-          if (value < threshold_begin || value > threshold_end)
-            {
-              reduced_buffer[j * reduced_width + i] = 0;
-              continue;
-            }
+  if (pyramids == NULL)
+    pyramids = depth_pyramid_pool_new ();
 
-          reduced_buffer[j * reduced_width + i] = value;
-        }
-    }
+  pyramid = depth_pyramid_pool_get (pyramids, width, height, dimension_factor);
+  depth_pyramid_build (pyramid, buffer, threshold_begin, threshold_end);
+  reduced = depth_pyramid_get_level (pyramid, dimension_factor);
 
   buffer_info = g_slice_new0 (BufferInfo);
-  buffer_info->reduced_buffer = reduced_buffer;
-  buffer_info->original_buffer = buffer;
-  buffer_info->reduced_width = reduced_width;
-  buffer_info->reduced_height = reduced_height;
+  buffer_info->pyramid = pyramid;
+  buffer_info->reduced_buffer = reduced->data;
+  buffer_info->original_buffer = depth_pyramid_get_level (pyramid, 1)->data;
+  buffer_info->reduced_width = reduced->width;
+  buffer_info->reduced_height = reduced->height;
   buffer_info->width = width;
   buffer_info->height = height;
+  buffer_info->timestamp = g_get_monotonic_time ();
 
   return buffer_info;
 }
 
+/* Shows the coarsest level of the pyramid */
 static guchar *
-create_grayscale_buffer (BufferInfo *buffer_info, gint dimension_reduction)
+create_grayscale_buffer (BufferInfo *buffer_info)
 {
   gint i, j;
   gint size;
   guchar *grayscale_buffer;
-  guint16 *reduced_buffer;
+  const DepthLevel *level;
 
-  reduced_buffer = buffer_info->reduced_buffer;
+  level = depth_pyramid_get_coarsest (buffer_info->pyramid);
 
   size = buffer_info->width * buffer_info->height * sizeof (guchar) * 3;
   grayscale_buffer = g_slice_alloc (size);
   /* Paint it white */
   memset (grayscale_buffer, 255, size);
 
-  for (i = 0; i < buffer_info->reduced_width; i++)
+  for (i = 0; i < level->width; i++)
     {
-      for (j = 0; j < buffer_info->reduced_height; j++)
+      for (j = 0; j < level->height; j++)
         {
-          if (reduced_buffer[j * buffer_info->reduced_width + i] != 0)
+          if (level->data[j * level->width + i] != 0)
             {
-              gint index = j * dimension_reduction * buffer_info->width +
-                i * dimension_reduction;
+              gint index = j * level->factor * buffer_info->width +
+                i * level->factor;
               grayscale_buffer_set_value (grayscale_buffer, index, 0);
             }
         }
@@ -573,74 +365,118 @@ create_grayscale_buffer (BufferInfo *buffer_info, gint dimension_reduction)
   return grayscale_buffer;
 }
 
-static Point *
-smooth_point (guint16 *buffer, guint width, guint height, SkeltrackJoint *joint)
+static void
+report_jitter (void)
 {
-  if (joint == NULL)
-    return NULL;
+  RealtimeJitterStats stats;
 
-  Point *closest;
-  gint i, j, x, y, radius, min, count;
-  radius = 16;
-  x = joint->screen_x;
-  y = joint->screen_y;
+  realtime_jitter_add_frame (jitter, g_get_monotonic_time ());
+  if (realtime_jitter_get_n_frames (jitter) < JITTER_REPORT_FRAMES)
+    return;
 
-  if (x >= width || y >= height)
-    return NULL;
+  realtime_jitter_take_stats (jitter, &stats);
+  g_message ("Frame jitter over %u frames: mean %.2f ms, 99%% %.2f ms, "
+             "max %.2f ms, %u late",
+             stats.n_frames,
+             stats.mean / 1000.0,
+             stats.p99 / 1000.0,
+             stats.max / 1000.0,
+             stats.n_late);
+}
 
-  closest = g_slice_new0 (Point);
+static void set_info_text (void);
 
-  closest->x = x;
-  closest->y = y;
-  closest->z = joint->z;
-  min = closest->z - 50;
+static gdouble
+get_cpu_seconds (const struct rusage *usage)
+{
+  return usage->ru_utime.tv_sec + usage->ru_utime.tv_usec / 1e6 +
+    usage->ru_stime.tv_sec + usage->ru_stime.tv_usec / 1e6;
+}
+
+static void
+enter_idle (guint16 *depth, gint width, gint height)
+{
+  idle = TRUE;
+  idle_start_time = g_get_monotonic_time ();
+  getrusage (RUSAGE_SELF, &idle_start_usage);
+
+  /* Nothing must stay pressed while nobody is there */
+  gesture_state_release_all (gestures);
+  gesture_state_reset (gestures);
+  dtw_recognizer_reset (recognizer);
+
+  if (motion == NULL)
+    motion = motion_detector_new (IDLE_DECIMATION);
+  motion_detector_reset (motion, depth, width, height);
+
+  g_debug ("Nobody seen for %d s, going idle", IDLE_TIMEOUT);
+  set_info_text ();
+}
+
+static void
+leave_idle (void)
+{
+  struct rusage usage;
+  gdouble seconds;
+
+  idle = FALSE;
+  last_tracked_time = g_get_monotonic_time ();
+
+  getrusage (RUSAGE_SELF, &usage);
+  seconds = (last_tracked_time - idle_start_time) / 1e6;
+  if (seconds > 0)
+    g_message ("Idle for %.1f s using %.1f%% of the CPU",
+               seconds,
+               100.0 * (get_cpu_seconds (&usage) -
+                        get_cpu_seconds (&idle_start_usage)) / seconds);
+  set_info_text ();
+}
 
-  count = 1;
+/* Tells whether DEPTH is to be tracked or whether the frame is
+   skipped because nobody has been around for a while */
+static gboolean
+check_idle (guint16 *depth, gint width, gint height)
+{
+  if (IDLE_TIMEOUT <= 0)
+    return FALSE;
 
-  for (i = x - radius; i < x + radius; i+=2)
+  if (! idle)
     {
-      if (i < 0 || i >= width)
-        continue;
-      for (j = y - radius; j < y + radius; j+=2)
-        {
-          guint16 current;
-          if (j < 0 || j >= height || (j == y && i == x))
-            continue;
+      if (last_tracked_time == 0)
+        last_tracked_time = g_get_monotonic_time ();
+      else if (g_get_monotonic_time () - last_tracked_time >
+               IDLE_TIMEOUT * G_USEC_PER_SEC)
+        enter_idle (depth, width, height);
 
-          current = buffer[j * width + i];
-          if (current < closest->z && current >= min)
-            {
-              closest->x += x;
-              closest->y += y;
-              count++;
-            }
-        }
+      return idle;
     }
 
-  closest->x /= count;
-  closest->y /= count;
+  if (! motion_detector_check (motion,
+                               depth,
+                               width,
+                               height,
+                               THRESHOLD_BEGIN,
+                               THRESHOLD_END))
+    return TRUE;
 
-  return closest;
+  leave_idle ();
+
+  return FALSE;
 }
 
 static void
-on_depth_frame (GFreenectDevice *kinect, gpointer user_data)
+process_depth_frame (guint16 *depth, gint width, gint height)
 {
-  gint width, height;
   gint dimension_factor;
   guchar *grayscale_buffer;
-  guint16 *depth;
   BufferInfo *buffer_info;
-  gsize len;
   GError *error = NULL;
-  GFreenectFrameMode frame_mode;
 
-  depth = (guint16 *) gfreenect_device_get_depth_frame_raw (kinect,
-                                                            &len,
-                                                            &frame_mode);
+  if (jitter != NULL)
+    report_jitter ();
 
-  width = frame_mode.width;
-  height = frame_mode.height;
+  if (check_idle (depth, width, height))
+    return;
 
   g_object_get (skeleton, "dimension-reduction", &dimension_factor, NULL);
 
@@ -651,6 +487,10 @@ on_depth_frame (GFreenectDevice *kinect, gpointer user_data)
                                 THRESHOLD_BEGIN,
                                 THRESHOLD_END);
 
+  /* For the next frames */
+  if (AUTO_THRESHOLD && follow_user (buffer_info))
+    set_info_text ();
+
   skeltrack_skeleton_track_joints (skeleton,
                                    buffer_info->reduced_buffer,
                                    buffer_info->reduced_width,
@@ -662,8 +502,7 @@ on_depth_frame (GFreenectDevice *kinect, gpointer user_data)
 
   if (!SHOW_SKELETON)
     {
-      grayscale_buffer = create_grayscale_buffer (buffer_info,
-                                                  dimension_factor);
+      grayscale_buffer = create_grayscale_buffer (buffer_info);
       if (! clutter_texture_set_from_rgb_data (CLUTTER_TEXTURE (depth_tex),
                                                grayscale_buffer,
                                                FALSE,
@@ -680,6 +519,106 @@ on_depth_frame (GFreenectDevice *kinect, gpointer user_data)
     }
 }
 
+static void
+record_depth_frame (guint16 *depth, gint width, gint height)
+{
+  GError *error = NULL;
+
+  if (recorder == NULL)
+    {
+      recorder = depth_recorder_new (RECORD_FILE, width, height, &error);
+      if (recorder == NULL)
+        {
+          g_warning ("Failed to record: %s", error->message);
+          g_error_free (error);
+          RECORD_FILE = NULL;
+          return;
+        }
+    }
+
+  if (! depth_recorder_add_frame (recorder,
+                                  depth,
+                                  g_get_monotonic_time (),
+                                  &error))
+    {
+      g_warning ("Stopped recording: %s", error->message);
+      g_error_free (error);
+      depth_recorder_close (recorder, NULL);
+      recorder = NULL;
+      RECORD_FILE = NULL;
+    }
+}
+
+static void
+on_depth_frame (GFreenectDevice *kinect, gpointer user_data)
+{
+  guint16 *depth;
+  gsize len;
+  GFreenectFrameMode frame_mode;
+
+  depth = (guint16 *) gfreenect_device_get_depth_frame_raw (kinect,
+                                                            &len,
+                                                            &frame_mode);
+
+  if (RECORD_FILE != NULL)
+    record_depth_frame (depth, frame_mode.width, frame_mode.height);
+
+  process_depth_frame (depth, frame_mode.width, frame_mode.height);
+}
+
+static gboolean
+on_replay_frame (gpointer user_data)
+{
+  const guint16 *depth;
+  guint width, height;
+  gint64 delay;
+  GError *error = NULL;
+
+  depth = depth_player_get_frame (player, replay_index, &error);
+  if (depth == NULL)
+    {
+      g_warning ("Failed to replay frame %u: %s", replay_index,
+                 error != NULL ? error->message : "invalid frame");
+      if (error != NULL)
+        g_error_free (error);
+      return FALSE;
+    }
+
+  depth_player_get_size (player, &width, &height);
+  process_depth_frame ((guint16 *) depth, width, height);
+
+  replay_index++;
+  if (replay_index >= depth_player_get_n_frames (player))
+    {
+      g_debug ("Finished replaying %s", REPLAY_FILE);
+      return FALSE;
+    }
+
+  /* Keep the pace the frames were recorded at */
+  delay = depth_player_get_timestamp (player, replay_index) -
+    depth_player_get_timestamp (player, replay_index - 1);
+  g_timeout_add (CLAMP (delay / 1000, 1, 1000), on_replay_frame, NULL);
+
+  return FALSE;
+}
+
+static gboolean
+on_synthetic_frame (gpointer user_data)
+{
+  synthetic_scene_render (scene,
+                          synthetic_frame,
+                          synthetic_buffer,
+                          synthetic_width,
+                          synthetic_height);
+  process_depth_frame (synthetic_buffer, synthetic_width, synthetic_height);
+
+  /* Play the script over and over */
+  synthetic_frame = (synthetic_frame + 1) %
+    synthetic_scene_get_n_frames (scene);
+
+  return TRUE;
+}
+
 static void
 paint_joint (cairo_t *cairo,
              SkeltrackJoint *joint,
@@ -713,7 +652,10 @@ on_texture_draw (ClutterCairoTexture *texture,
 {
   guint width, height;
   ClutterColor *color;
+  SkeltrackJointList list;
   SkeltrackJoint *head, *left_hand, *right_hand;
+
+  joint_exchange_read (view_joints, &list);
   if (list == NULL)
     return;
 
@@ -736,21 +678,28 @@ on_texture_draw (ClutterCairoTexture *texture,
   paint_joint (cairo, head, 50, "#FFF800");
   paint_joint (cairo, left_hand, 30, "#C2FF00");
   paint_joint (cairo, right_hand, 30, "#00FAFF");
-
-  skeltrack_joint_list_free (list);
-  list = NULL;
 }
 
 static void
 set_info_text (void)
 {
   gchar *title;
+  GestureConfig *config;
+
+  config = gesture_state_get_config (gestures);
   title = g_strdup_printf ("<b>Current View:</b> %s\n"
                            "<b>Double hand mode:</b> %s\n"
-                           "<b>Threshold:</b> %d",
+                           "<b>Click:</b> %s\n"
+                           "<b>Threshold:</b> %d-%d%s",
+                           idle ? "Idle" :
                            SHOW_SKELETON ? "Skeleton" : "Point Cloud",
-                           DOUBLE_HAND_WHEEL_MODE ? "Steering Wheel": "Pinch",
-                           THRESHOLD_END);
+                           config->double_hand_wheel_mode ?
+                           "Steering Wheel": "Pinch",
+                           config->grab_mode ? "Closing the hand" :
+                           "Second hand",
+                           THRESHOLD_BEGIN,
+                           THRESHOLD_END,
+                           AUTO_THRESHOLD ? " (automatic)" : "");
   clutter_text_set_markup (CLUTTER_TEXT (info_text), title);
   g_free (title);
 }
@@ -789,12 +738,11 @@ on_key_release (ClutterActor *actor,
                 ClutterEvent *event,
                 gpointer data)
 {
-  GFreenectDevice *kinect;
   guint key;
+  GestureConfig *config;
+  gchar *template;
   g_return_val_if_fail (event != NULL, FALSE);
 
-  kinect = GFREENECT_DEVICE (data);
-
   key = clutter_event_get_key_symbol (event);
   switch (key)
     {
@@ -802,19 +750,39 @@ on_key_release (ClutterActor *actor,
       SHOW_SKELETON = !SHOW_SKELETON;
       break;
     case CLUTTER_KEY_Tab:
-      DOUBLE_HAND_WHEEL_MODE = !DOUBLE_HAND_WHEEL_MODE;
+      config = gesture_state_get_config (gestures);
+      config->double_hand_wheel_mode = !config->double_hand_wheel_mode;
+      break;
+    case CLUTTER_KEY_c:
+      config = gesture_state_get_config (gestures);
+      config->grab_mode = !config->grab_mode;
       break;
     case CLUTTER_KEY_plus:
+      AUTO_THRESHOLD = FALSE;
       set_threshold (100);
       break;
     case CLUTTER_KEY_minus:
+      AUTO_THRESHOLD = FALSE;
       set_threshold (-100);
       break;
+    case CLUTTER_KEY_a:
+      AUTO_THRESHOLD = !AUTO_THRESHOLD;
+      depth_window_set (depth_window, THRESHOLD_BEGIN, THRESHOLD_END);
+      break;
+    case CLUTTER_KEY_g:
+      template = dtw_recognizer_dump_trajectory (recognizer,
+                                                 2 * SYNTHETIC_SCENE_FPS);
+      if (template != NULL)
+        g_print ("%s\n", template);
+      g_free (template);
+      break;
     case CLUTTER_KEY_Up:
-      set_tilt_angle (kinect, 5);
+      if (kinect != NULL)
+        set_tilt_angle (kinect, 5);
       break;
     case CLUTTER_KEY_Down:
-      set_tilt_angle (kinect, -5);
+      if (kinect != NULL)
+        set_tilt_angle (kinect, -5);
       break;
     }
   set_info_text ();
@@ -830,54 +798,44 @@ create_instructions (void)
   clutter_text_set_markup (CLUTTER_TEXT (text),
                            "<b>Instructions:</b>\n"
                            "\tChange between double hand mode:  \tTab\n"
+                           "\tClick by closing the hand:  \t\tC\n"
                            "\tChange between skeleton\n"
                            "\t  tracking and threshold view:  \tSpace bar\n"
                            "\tSet tilt angle:  \t\t\t\tUp/Down Arrows\n"
-                           "\tIncrease threshold:  \t\t\t+/-");
+                           "\tPrint the last movement\n"
+                           "\t  as a template:  \t\t\tG\n"
+                           "\tIncrease threshold:  \t\t\t+/-\n"
+                           "\tAutomatic threshold:  \t\t\tA");
   return text;
 }
 
 static void
 on_destroy (ClutterActor *actor, gpointer data)
 {
-  GFreenectDevice *device = GFREENECT_DEVICE (data);
-  gfreenect_device_stop_depth_stream (device, NULL);
+  if (kinect != NULL)
+    gfreenect_device_stop_depth_stream (kinect, NULL);
   clutter_main_quit ();
 }
 
 static void
-on_new_kinect_device (GObject      *obj,
-                      GAsyncResult *res,
-                      gpointer      user_data)
+create_stage (void)
 {
   ClutterActor *stage, *instructions;
-  GError *error = NULL;
   gint width = 640;
   gint height = 480;
 
-  kinect = gfreenect_device_new_finish (res, &error);
-  if (kinect == NULL)
-    {
-      g_debug ("Failed to created kinect device: %s", error->message);
-      g_error_free (error);
-      clutter_main_quit ();
-      return;
-    }
-
-  g_debug ("Kinect device created!");
-
   g_debug ("SCREEN: %d %d", screen_width, screen_height);
 
   stage = clutter_stage_get_default ();
   clutter_stage_set_title (CLUTTER_STAGE (stage), "Skeltrack Desktop Control");
-  clutter_actor_set_size (stage, width, height + 220);
+  clutter_actor_set_size (stage, width, height + 260);
   clutter_stage_set_user_resizable (CLUTTER_STAGE (stage), TRUE);
 
-  g_signal_connect (stage, "destroy", G_CALLBACK (on_destroy), kinect);
+  g_signal_connect (stage, "destroy", G_CALLBACK (on_destroy), NULL);
   g_signal_connect (stage,
                     "key-release-event",
                     G_CALLBACK (on_key_release),
-                    kinect);
+                    NULL);
 
   depth_tex = clutter_cairo_texture_new (width, height);
   clutter_container_add_actor (CLUTTER_CONTAINER (stage), depth_tex);
@@ -888,22 +846,47 @@ on_new_kinect_device (GObject      *obj,
   clutter_container_add_actor (CLUTTER_CONTAINER (stage), info_text);
 
   instructions = create_instructions ();
-  clutter_actor_set_position (instructions, 50, height + 90);
+  clutter_actor_set_position (instructions, 50, height + 100);
   clutter_container_add_actor (CLUTTER_CONTAINER (stage), instructions);
 
   clutter_actor_show_all (stage);
 
   skeleton = SKELTRACK_SKELETON (skeltrack_skeleton_new ());
-
-  g_signal_connect (kinect,
-                    "depth-frame",
-                    G_CALLBACK (on_depth_frame),
-                    NULL);
+  if (DIMENSION_REDUCTIONS != NULL && atoi (DIMENSION_REDUCTIONS) > 0)
+    g_object_set (skeleton,
+                  "dimension-reduction", atoi (DIMENSION_REDUCTIONS),
+                  NULL);
 
   g_signal_connect (depth_tex,
                     "draw",
                     G_CALLBACK (on_texture_draw),
                     NULL);
+}
+
+static void
+on_new_kinect_device (GObject      *obj,
+                      GAsyncResult *res,
+                      gpointer      user_data)
+{
+  GError *error = NULL;
+
+  kinect = gfreenect_device_new_finish (res, &error);
+  if (kinect == NULL)
+    {
+      g_debug ("Failed to created kinect device: %s", error->message);
+      g_error_free (error);
+      clutter_main_quit ();
+      return;
+    }
+
+  g_debug ("Kinect device created!");
+
+  create_stage ();
+
+  g_signal_connect (kinect,
+                    "depth-frame",
+                    G_CALLBACK (on_depth_frame),
+                    NULL);
 
   gfreenect_device_set_tilt_angle (kinect, 0, NULL, NULL, NULL);
 
@@ -912,6 +895,319 @@ on_new_kinect_device (GObject      *obj,
                                        NULL);
 }
 
+static gboolean
+parse_size (const gchar *size, guint *width, guint *height)
+{
+  gchar *end;
+
+  *width = g_ascii_strtoull (size, &end, 10);
+  if (*end != 'x' || *width == 0)
+    return FALSE;
+
+  *height = g_ascii_strtoull (end + 1, &end, 10);
+  return *end == '\0' && *height > 0;
+}
+
+/* Runs the whole script through the pipeline at one size and dimension
+   reduction, printing how long each step took */
+static gboolean
+run_benchmark_pass (guint width, guint height, guint dimension_factor)
+{
+  gint64 render_time = 0, reduce_time = 0, track_time = 0;
+  gint64 gestures_time = 0, templates_time = 0, start;
+  gint64 encode_time = 0, decode_time = 0;
+  guint16 *depth, *previous, *decoded, *previous_decoded;
+  guint8 *encoded;
+  gsize encoded_size = 0;
+  guint i, n_frames, n_skeletons = 0, n_allocations = 0, n_mismatches = 0;
+  guint threshold_begin, threshold_end;
+  const InputEvent *events;
+  guint n_events;
+  gboolean success;
+  GString *report;
+
+  /* Every pass starts from the scene's threshold */
+  threshold_begin = THRESHOLD_BEGIN;
+  threshold_end = THRESHOLD_END;
+  if (depth_window != NULL)
+    depth_window_set (depth_window, THRESHOLD_BEGIN, THRESHOLD_END);
+  last_head_time = 0;
+
+  n_frames = synthetic_scene_get_n_frames (scene);
+  depth = g_new (guint16, width * height);
+  previous = g_new (guint16, width * height);
+  decoded = g_new (guint16, width * height);
+  previous_decoded = g_new (guint16, width * height);
+  encoded = g_malloc (depth_codec_get_max_encoded_size (width, height));
+  g_object_set (skeleton, "dimension-reduction", dimension_factor, NULL);
+  gesture_state_clear_events (gestures);
+  gesture_state_reset (gestures);
+  dtw_recognizer_reset (recognizer);
+
+  for (i = 0; i < n_frames; i++)
+    {
+      BufferInfo *buffer_info;
+      SkeltrackJointList joints;
+      GError *error = NULL;
+
+      start = g_get_monotonic_time ();
+      synthetic_scene_render (scene, i, depth, width, height);
+      render_time += g_get_monotonic_time () - start;
+
+      /* What --record and --replay would do with the frame, with a
+         key frame every second as in recordings */
+      {
+        const guint16 *reference;
+        gsize size;
+        guint16 *swap;
+        gboolean same;
+
+        reference = i % SYNTHETIC_SCENE_FPS == 0 ? NULL : previous;
+        start = g_get_monotonic_time ();
+        size = depth_codec_encode (depth, reference, width, height, encoded);
+        encode_time += g_get_monotonic_time () - start;
+        encoded_size += size;
+
+        reference = i % SYNTHETIC_SCENE_FPS == 0 ? NULL : previous_decoded;
+        start = g_get_monotonic_time ();
+        same = depth_codec_decode (encoded, size, reference,
+                                   width, height, decoded);
+        decode_time += g_get_monotonic_time () - start;
+        if (! same ||
+            memcmp (decoded, depth, width * height * sizeof (guint16)) != 0)
+          n_mismatches++;
+
+        memcpy (previous, depth, width * height * sizeof (guint16));
+        swap = previous_decoded;
+        previous_decoded = decoded;
+        decoded = swap;
+      }
+
+      start = g_get_monotonic_time ();
+      buffer_info = process_buffer (depth,
+                                    width,
+                                    height,
+                                    dimension_factor,
+                                    THRESHOLD_BEGIN,
+                                    THRESHOLD_END);
+      buffer_info->timestamp = synthetic_scene_get_timestamp (scene, i);
+      reduce_time += g_get_monotonic_time () - start;
+
+      start = g_get_monotonic_time ();
+      joints = skeltrack_skeleton_track_joints_sync (skeleton,
+                                                     buffer_info->reduced_buffer,
+                                                     buffer_info->reduced_width,
+                                                     buffer_info->reduced_height,
+                                                     NULL,
+                                                     &error);
+      track_time += g_get_monotonic_time () - start;
+
+      if (error != NULL)
+        {
+          g_error_free (error);
+        }
+      else if (joints != NULL)
+        {
+          guint allocations;
+
+          n_skeletons++;
+          see_head (joints, buffer_info->timestamp);
+          allocations = alloc_counter_get ();
+          start = g_get_monotonic_time ();
+          gesture_state_interpret (gestures,
+                                   joints,
+                                   buffer_info->original_buffer,
+                                   width,
+                                   height,
+                                   synthetic_scene_get_timestamp (scene, i));
+          gestures_time += g_get_monotonic_time () - start;
+
+          /* Give the first second to warm up */
+          if (i >= SYNTHETIC_SCENE_FPS)
+            n_allocations += alloc_counter_get () - allocations;
+
+          start = g_get_monotonic_time ();
+          recognize_templates (joints);
+          templates_time += g_get_monotonic_time () - start;
+          skeltrack_joint_list_free (joints);
+        }
+
+      if (depth_window != NULL)
+        follow_user (buffer_info);
+
+      depth_pyramid_release (buffer_info->pyramid);
+      g_slice_free (BufferInfo, buffer_info);
+    }
+
+  report = g_string_new (NULL);
+  events = gesture_state_get_events (gestures, &n_events);
+  success = synthetic_scene_check_events (scene, events, n_events, report);
+  if (n_allocations > 0)
+    {
+      g_string_append_printf (report,
+                              "%u heap allocations in the gestures "
+                              "after warming up\n",
+                              n_allocations);
+      success = FALSE;
+    }
+  if (n_mismatches > 0)
+    {
+      g_string_append_printf (report,
+                              "%u frames not decoded as they were "
+                              "recorded\n",
+                              n_mismatches);
+      success = FALSE;
+    }
+
+  g_print ("%ux%u /%u: %u frames, %u skeletons, "
+           "render %.2f ms, reduce %.2f ms, "
+           "skeltrack %.2f ms, gestures %.3f ms, templates %.3f ms "
+           "(%.0f fps without rendering), %u events, %s\n",
+           width, height, dimension_factor,
+           n_frames, n_skeletons,
+           render_time / 1000.0 / n_frames,
+           reduce_time / 1000.0 / n_frames,
+           track_time / 1000.0 / n_frames,
+           gestures_time / 1000.0 / n_frames,
+           templates_time / 1000.0 / n_frames,
+           n_frames * 1e6 / MAX (1, reduce_time + track_time +
+                                 gestures_time + templates_time),
+           n_events,
+           success ? "OK" : "FAILED");
+  if (depth_window != NULL)
+    g_print ("  threshold: %u-%u at the end\n", THRESHOLD_BEGIN, THRESHOLD_END);
+  g_print ("  recording: %.1f:1, encode %.2f ms, decode %.2f ms "
+           "(%.0f fps)\n",
+           (gdouble) n_frames * width * height * sizeof (guint16) /
+           MAX (1, encoded_size),
+           encode_time / 1000.0 / n_frames,
+           decode_time / 1000.0 / n_frames,
+           n_frames * 1e6 / MAX (1, decode_time));
+  if (! success)
+    g_print ("  %s", report->str);
+
+  g_string_free (report, TRUE);
+  g_free (encoded);
+  g_free (previous_decoded);
+  g_free (decoded);
+  g_free (previous);
+  g_free (depth);
+  THRESHOLD_BEGIN = threshold_begin;
+  THRESHOLD_END = threshold_end;
+
+  return success;
+}
+
+/* Done before any thread is started, so that they all inherit the
+   affinity; the priority only applies to this thread, which handles the
+   frames. Whatever is not permitted is only warned about */
+static void
+setup_realtime (void)
+{
+  GError *error = NULL;
+
+  if (REALTIME_CPUS != NULL && ! realtime_set_affinity (REALTIME_CPUS, &error))
+    {
+      g_warning ("%s", error->message);
+      g_error_free (error);
+      error = NULL;
+    }
+
+  if (REALTIME)
+    {
+      if (! realtime_set_priority (REALTIME_PRIORITY, &error))
+        {
+          g_warning ("%s", error->message);
+          g_error_free (error);
+          error = NULL;
+        }
+
+      if (! realtime_lock_memory (&error))
+        {
+          g_warning ("%s", error->message);
+          g_error_free (error);
+          error = NULL;
+        }
+    }
+
+  /* The Kinect sends 30 frames per second */
+  if (REALTIME || REPORT_JITTER)
+    jitter = realtime_jitter_new (G_USEC_PER_SEC / 30);
+}
+
+static gint
+run_benchmark (void)
+{
+  gchar **sizes, **factors;
+  gchar default_factor[16];
+  gboolean success = TRUE;
+  gint dimension_factor;
+  guint i, j;
+
+  if (scene == NULL)
+    {
+      g_printerr ("--benchmark needs a --synthetic script\n");
+      return -1;
+    }
+
+  /* No desktop: events are only kept to be checked */
+  if (screen_width == 0 || screen_height == 0)
+    {
+      screen_width = 1920;
+      screen_height = 1080;
+    }
+  /* A few events per frame at most */
+  gesture_state_capture_events (gestures,
+                                screen_width,
+                                screen_height,
+                                synthetic_scene_get_n_frames (scene) * 4);
+  skeleton = SKELTRACK_SKELETON (skeltrack_skeleton_new ());
+  if (synthetic_scene_get_auto_threshold (scene))
+    depth_window = depth_window_new (THRESHOLD_BEGIN, THRESHOLD_END);
+  if (! alloc_counter_is_enabled ())
+    g_print ("Not checking the gestures' allocations: "
+             "configure with --enable-alloc-counter\n");
+
+  g_object_get (skeleton, "dimension-reduction", &dimension_factor, NULL);
+  sizes = g_strsplit (SYNTHETIC_SIZES ? SYNTHETIC_SIZES : "640x480", ",", -1);
+  g_snprintf (default_factor, sizeof (default_factor), "%d", dimension_factor);
+  factors = g_strsplit (DIMENSION_REDUCTIONS ? DIMENSION_REDUCTIONS :
+                        default_factor, ",", -1);
+
+  for (i = 0; sizes[i] != NULL; i++)
+    {
+      guint width, height;
+
+      if (! parse_size (sizes[i], &width, &height))
+        {
+          g_printerr ("Invalid size: %s\n", sizes[i]);
+          success = FALSE;
+          continue;
+        }
+
+      for (j = 0; factors[j] != NULL; j++)
+        {
+          dimension_factor = atoi (factors[j]);
+          if (dimension_factor <= 0)
+            {
+              g_printerr ("Invalid dimension reduction: %s\n", factors[j]);
+              success = FALSE;
+              continue;
+            }
+
+          success = run_benchmark_pass (width, height, dimension_factor) &&
+            success;
+        }
+    }
+
+  g_strfreev (sizes);
+  g_strfreev (factors);
+  if (depth_window != NULL)
+    depth_window_free (depth_window);
+
+  return success ? 0 : 1;
+}
+
 static void
 quit (gint signale)
 {
@@ -924,33 +1220,204 @@ int
 main (int argc, char *argv[])
 {
   Screen *screen;
+  GOptionContext *context;
+  GError *error = NULL;
+  gboolean parsed;
+
+  context = g_option_context_new (NULL);
+  g_option_context_add_main_entries (context, entries, NULL);
+  g_option_context_add_group (context,
+                              clutter_get_option_group_without_init ());
+  parsed = g_option_context_parse (context, &argc, &argv, &error);
+  g_option_context_free (context);
+  if (! parsed)
+    {
+      g_printerr ("%s\n", error->message);
+      g_error_free (error);
+      return -1;
+    }
+
+  /* Every thread of the work pool would run at the real-time priority
+     with all its frames locked in memory, and there is no stream whose
+     jitter could be measured; --cpus still restricts the pool */
+  if (BATCH_FILE != NULL && (REALTIME || REPORT_JITTER))
+    {
+      g_printerr ("--batch cannot be used with --realtime or --jitter\n");
+      return -1;
+    }
+
+  setup_realtime ();
+
+  if (BATCH_FILE != NULL)
+    {
+#if !GLIB_CHECK_VERSION (2, 35, 0)
+      g_type_init ();
+#endif
+      return batch_run (BATCH_FILE, THRESHOLD_BEGIN, THRESHOLD_END);
+    }
+
+  gestures = gesture_state_new ();
+  gesture_state_get_config (gestures)->grab_mode = GRAB_MODE;
+  recognizer = dtw_recognizer_new ();
+  if (TEMPLATES_FILE != NULL &&
+      ! dtw_recognizer_load (recognizer, TEMPLATES_FILE, &error))
+    {
+      g_printerr ("%s\n", error->message);
+      g_error_free (error);
+      return -1;
+    }
+
+  if (SYNTHETIC_SCRIPT != NULL)
+    {
+      scene = synthetic_scene_new (SYNTHETIC_SCRIPT, &error);
+      if (scene == NULL)
+        {
+          g_printerr ("%s\n", error->message);
+          g_error_free (error);
+          return -1;
+        }
+      gesture_state_get_config (gestures)->double_hand_wheel_mode =
+        ! synthetic_scene_get_pinch_mode (scene);
+      if (synthetic_scene_get_grab_mode (scene))
+        gesture_state_get_config (gestures)->grab_mode = TRUE;
+      /* The default threshold is for someone closer than the
+         scripts usually put the person */
+      synthetic_scene_get_threshold (scene,
+                                     &THRESHOLD_BEGIN,
+                                     &THRESHOLD_END);
+    }
+
+  if (BENCHMARK)
+    {
+      gint status;
+
+#if !GLIB_CHECK_VERSION (2, 35, 0)
+      g_type_init ();
+#endif
+      status = run_benchmark ();
+      if (scene != NULL)
+        synthetic_scene_free (scene);
+      if (skeleton != NULL)
+        g_object_unref (skeleton);
+      gesture_state_free (gestures);
+      dtw_recognizer_free (recognizer);
+      if (jitter != NULL)
+        realtime_jitter_free (jitter);
+      if (pyramids != NULL)
+        depth_pyramid_pool_free (pyramids);
+
+      return status;
+    }
 
   display = XOpenDisplay (0);
+  if (display == NULL)
+    {
+      g_printerr ("Cannot open the X display\n");
+      return -1;
+    }
   screen = XDefaultScreenOfDisplay (display);
   screen_width = XWidthOfScreen (screen);
   screen_height = XHeightOfScreen (screen);
 
-  if (clutter_init (&argc, &argv) != CLUTTER_INIT_SUCCESS ||
-      display == NULL || screen == NULL)
+  if (clutter_init (&argc, &argv) != CLUTTER_INIT_SUCCESS || screen == NULL)
     {
       XCloseDisplay (display);
       return -1;
     }
 
-  gfreenect_device_new (0,
-                        GFREENECT_SUBDEVICE_CAMERA,
-                        NULL,
-                        on_new_kinect_device,
-                        NULL);
+  gesture_state_set_display (gestures, display, screen_width, screen_height);
+  view_joints = joint_exchange_new ();
+  depth_window = depth_window_new (THRESHOLD_BEGIN, THRESHOLD_END);
+
+  if (PUBLISH_SOCKET != NULL)
+    {
+      /* Room for the depth as Skeltrack gets it, which
+         is never bigger than the sensor's frame */
+      publisher = joint_publisher_new (PUBLISH_SOCKET,
+                                       PUBLISH_DEPTH ? 640 : 0,
+                                       PUBLISH_DEPTH ? 480 : 0,
+                                       &error);
+      if (publisher == NULL)
+        {
+          g_warning ("Failed to publish joints: %s", error->message);
+          g_error_free (error);
+          error = NULL;
+        }
+    }
+
+  if (REPLAY_FILE != NULL)
+    {
+      player = depth_player_new (REPLAY_FILE, &error);
+      if (player == NULL)
+        {
+          g_printerr ("Failed to replay: %s\n", error->message);
+          g_error_free (error);
+          XCloseDisplay (display);
+          return -1;
+        }
+
+      create_stage ();
+      g_idle_add (on_replay_frame, NULL);
+    }
+  else if (scene != NULL)
+    {
+      if (SYNTHETIC_SIZES != NULL &&
+          ! parse_size (SYNTHETIC_SIZES, &synthetic_width, &synthetic_height))
+        {
+          g_printerr ("Invalid size: %s\n", SYNTHETIC_SIZES);
+          synthetic_scene_free (scene);
+          XCloseDisplay (display);
+          return -1;
+        }
+      synthetic_buffer = g_new (guint16, synthetic_width * synthetic_height);
+
+      create_stage ();
+      g_timeout_add (1000 / SYNTHETIC_SCENE_FPS, on_synthetic_frame, NULL);
+    }
+  else
+    {
+      gfreenect_device_new (0,
+                            GFREENECT_SUBDEVICE_CAMERA,
+                            NULL,
+                            on_new_kinect_device,
+                            NULL);
+    }
 
   signal (SIGINT, quit);
 
   clutter_main ();
 
-  if (last_left_point != NULL)
-    g_slice_free (Point, last_left_point);
-  if (last_right_point != NULL)
-    g_slice_free (Point, last_right_point);
+  gesture_state_free (gestures);
+  dtw_recognizer_free (recognizer);
+  joint_exchange_free (view_joints);
+  depth_window_free (depth_window);
+
+  if (publisher != NULL)
+    joint_publisher_free (publisher);
+
+  if (recorder != NULL && ! depth_recorder_close (recorder, &error))
+    {
+      g_warning ("Failed to finish the recording: %s", error->message);
+      g_error_free (error);
+    }
+
+  if (player != NULL)
+    depth_player_free (player);
+
+  if (scene != NULL)
+    {
+      synthetic_scene_free (scene);
+      g_free (synthetic_buffer);
+    }
+
+  if (motion != NULL)
+    motion_detector_free (motion);
+
+  if (jitter != NULL)
+    realtime_jitter_free (jitter);
+
+  if (pyramids != NULL)
+    depth_pyramid_pool_free (pyramids);
 
   if (kinect != NULL)
     g_object_unref (kinect);
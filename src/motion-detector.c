@@ -0,0 +1,153 @@
+/* Skeltrack Desktop Control: Motion Detector
+ *
+ * Copyright (c) 2012 Igalia, S.L.
+ *
+ * Author: Joaquim Rocha <jrocha@igalia.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/* Tells whether anything moved between two depth frames by looking at a
+   few of their pixels: one in DECIMATION in each direction, so a 640x480
+   frame decimated by 16 is compared as 40x30 samples. Only the samples
+   inside the tracking threshold, in either frame, count, so that someone
+   walking behind it does not look like motion. */
+
+#include "motion-detector.h"
+
+/* Difference in millimeters for a sample to be considered changed;
+   well above the sensor's noise at a few meters */
+#define MIN_DEPTH_CHANGE 100
+
+/* Fraction of the samples that must change for it to be motion */
+#define MIN_CHANGED_FRACTION 0.01
+#define MIN_CHANGED 3
+
+struct _MotionDetector
+{
+  guint decimation;
+  guint width;
+  guint height;
+  guint16 *reference;
+};
+
+MotionDetector *
+motion_detector_new (guint decimation)
+{
+  MotionDetector *detector;
+
+  g_return_val_if_fail (decimation > 0, NULL);
+
+  detector = g_slice_new0 (MotionDetector);
+  detector->decimation = decimation;
+
+  return detector;
+}
+
+void
+motion_detector_free (MotionDetector *detector)
+{
+  g_return_if_fail (detector != NULL);
+
+  g_free (detector->reference);
+  g_slice_free (MotionDetector, detector);
+}
+
+/* Takes DEPTH as the frame the next one is compared with */
+void
+motion_detector_reset (MotionDetector *detector,
+                       const guint16  *depth,
+                       guint           width,
+                       guint           height)
+{
+  guint i, j, step, offset;
+  guint16 *sample;
+
+  g_return_if_fail (detector != NULL && depth != NULL);
+
+  step = detector->decimation;
+  if (detector->width != width / step || detector->height != height / step)
+    {
+      detector->width = width / step;
+      detector->height = height / step;
+      g_free (detector->reference);
+      detector->reference = g_new (guint16,
+                                   detector->width * detector->height);
+    }
+
+  /* The pixel in the middle of each block */
+  offset = step / 2;
+  sample = detector->reference;
+  for (j = 0; j < detector->height; j++)
+    {
+      const guint16 *row = depth + (j * step + offset) * width + offset;
+
+      for (i = 0; i < detector->width; i++)
+        *sample++ = row[i * step];
+    }
+}
+
+/* Compares DEPTH with the last frame given and keeps it for the next
+   comparison. Returns TRUE when there was motion. */
+gboolean
+motion_detector_check (MotionDetector *detector,
+                       const guint16  *depth,
+                       guint           width,
+                       guint           height,
+                       guint           threshold_begin,
+                       guint           threshold_end)
+{
+  guint i, j, step, offset, changed, min_changed;
+  guint16 *sample;
+
+  g_return_val_if_fail (detector != NULL && depth != NULL, FALSE);
+
+  step = detector->decimation;
+  if (detector->reference == NULL ||
+      detector->width != width / step ||
+      detector->height != height / step)
+    {
+      motion_detector_reset (detector, depth, width, height);
+      return TRUE;
+    }
+
+  offset = step / 2;
+  sample = detector->reference;
+  changed = 0;
+  for (j = 0; j < detector->height; j++)
+    {
+      const guint16 *row = depth + (j * step + offset) * width + offset;
+
+      for (i = 0; i < detector->width; i++, sample++)
+        {
+          guint16 value = row[i * step];
+          gboolean inside, was_inside;
+
+          inside = value >= threshold_begin && value <= threshold_end;
+          was_inside = *sample >= threshold_begin && *sample <= threshold_end;
+          if ((inside || was_inside) &&
+              ABS ((gint) value - (gint) *sample) > MIN_DEPTH_CHANGE)
+            changed++;
+
+          *sample = value;
+        }
+    }
+
+  min_changed = MAX (MIN_CHANGED,
+                     detector->width * detector->height *
+                     MIN_CHANGED_FRACTION);
+
+  return changed >= min_changed;
+}
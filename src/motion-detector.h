@@ -0,0 +1,45 @@
+/* Skeltrack Desktop Control: Motion Detector
+ *
+ * Copyright (c) 2012 Igalia, S.L.
+ *
+ * Author: Joaquim Rocha <jrocha@igalia.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef __MOTION_DETECTOR_H__
+#define __MOTION_DETECTOR_H__
+
+#include <glib.h>
+
+typedef struct _MotionDetector MotionDetector;
+
+MotionDetector * motion_detector_new    (guint decimation);
+
+void             motion_detector_free   (MotionDetector *detector);
+
+void             motion_detector_reset  (MotionDetector *detector,
+                                         const guint16  *depth,
+                                         guint           width,
+                                         guint           height);
+
+gboolean         motion_detector_check  (MotionDetector *detector,
+                                         const guint16  *depth,
+                                         guint           width,
+                                         guint           height,
+                                         guint           threshold_begin,
+                                         guint           threshold_end);
+
+#endif /* __MOTION_DETECTOR_H__ */
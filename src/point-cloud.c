@@ -0,0 +1,141 @@
+/* Skeltrack Desktop Control: Point Cloud
+ *
+ * Copyright (c) 2012 Igalia, S.L.
+ *
+ * Author: Joaquim Rocha <jrocha@igalia.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/* Turns depth pixels into points in millimeters, in the camera's
+   coordinates (X right, Y down, Z away from the sensor).
+
+   A pixel's X and Y are its depth times a factor that only depends on
+   its column and row respectively, so those factors are computed once
+   from the sensor's intrinsics and a conversion is two multiplications. */
+
+#include "point-cloud.h"
+
+/* Intrinsics of the Kinect's depth camera at 640x480,
+   scaled for other sizes */
+#define FOCAL_LENGTH_X_640 594.21
+#define FOCAL_LENGTH_Y_640 591.04
+#define CENTER_X_640 339.31
+#define CENTER_Y_640 242.74
+
+struct _PointCloud
+{
+  guint width;
+  guint height;
+  gfloat *columns;
+  gfloat *rows;
+};
+
+PointCloud *
+point_cloud_new (guint width, guint height)
+{
+  PointCloud *cloud;
+  gdouble scale_x, scale_y;
+  guint i;
+
+  g_return_val_if_fail (width > 0 && height > 0, NULL);
+
+  cloud = g_slice_new0 (PointCloud);
+  cloud->width = width;
+  cloud->height = height;
+  cloud->columns = g_new (gfloat, width);
+  cloud->rows = g_new (gfloat, height);
+
+  scale_x = width / 640.0;
+  scale_y = height / 480.0;
+  for (i = 0; i < width; i++)
+    cloud->columns[i] = (i - CENTER_X_640 * scale_x) /
+      (FOCAL_LENGTH_X_640 * scale_x);
+  for (i = 0; i < height; i++)
+    cloud->rows[i] = (i - CENTER_Y_640 * scale_y) /
+      (FOCAL_LENGTH_Y_640 * scale_y);
+
+  return cloud;
+}
+
+void
+point_cloud_free (PointCloud *cloud)
+{
+  g_return_if_fail (cloud != NULL);
+
+  g_free (cloud->columns);
+  g_free (cloud->rows);
+  g_slice_free (PointCloud, cloud);
+}
+
+guint
+point_cloud_get_width (PointCloud *cloud)
+{
+  g_return_val_if_fail (cloud != NULL, 0);
+
+  return cloud->width;
+}
+
+guint
+point_cloud_get_height (PointCloud *cloud)
+{
+  g_return_val_if_fail (cloud != NULL, 0);
+
+  return cloud->height;
+}
+
+void
+point_cloud_get_point (PointCloud *cloud,
+                       guint       column,
+                       guint       row,
+                       gfloat      depth,
+                       gfloat     *x,
+                       gfloat     *y)
+{
+  *x = cloud->columns[MIN (column, cloud->width - 1)] * depth;
+  *y = cloud->rows[MIN (row, cloud->height - 1)] * depth;
+}
+
+/* Converts N_PIXELS of DEPTH, which start at COLUMN of ROW, into X, Y
+   and Z. Pixels without a reading come out as zeros. */
+void
+point_cloud_convert_row (PointCloud             *cloud,
+                         const guint16 * restrict depth,
+                         guint                   row,
+                         guint                   column,
+                         guint                   n_pixels,
+                         gfloat        * restrict x,
+                         gfloat        * restrict y,
+                         gfloat        * restrict z)
+{
+  const gfloat * restrict columns;
+  gfloat row_factor;
+  guint i;
+
+  g_return_if_fail (row < cloud->height &&
+                    column + n_pixels <= cloud->width);
+
+  columns = cloud->columns + column;
+  row_factor = cloud->rows[row];
+
+  for (i = 0; i < n_pixels; i++)
+    {
+      gfloat value = depth[i];
+
+      z[i] = value;
+      x[i] = columns[i] * value;
+      y[i] = row_factor * value;
+    }
+}
@@ -0,0 +1,54 @@
+/* Skeltrack Desktop Control: Point Cloud
+ *
+ * Copyright (c) 2012 Igalia, S.L.
+ *
+ * Author: Joaquim Rocha <jrocha@igalia.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef __POINT_CLOUD_H__
+#define __POINT_CLOUD_H__
+
+#include <glib.h>
+
+typedef struct _PointCloud PointCloud;
+
+PointCloud * point_cloud_new          (guint width,
+                                       guint height);
+
+void         point_cloud_free         (PointCloud *cloud);
+
+guint        point_cloud_get_width    (PointCloud *cloud);
+
+guint        point_cloud_get_height   (PointCloud *cloud);
+
+void         point_cloud_get_point    (PointCloud *cloud,
+                                       guint       column,
+                                       guint       row,
+                                       gfloat      depth,
+                                       gfloat     *x,
+                                       gfloat     *y);
+
+void         point_cloud_convert_row  (PointCloud    *cloud,
+                                       const guint16 *depth,
+                                       guint          row,
+                                       guint          column,
+                                       guint          n_pixels,
+                                       gfloat        *x,
+                                       gfloat        *y,
+                                       gfloat        *z);
+
+#endif /* __POINT_CLOUD_H__ */
@@ -0,0 +1,313 @@
+/* Skeltrack Desktop Control: Real-time
+ *
+ * Copyright (c) 2012 Igalia, S.L.
+ *
+ * Author: Joaquim Rocha <jrocha@igalia.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/* Keeps the tracking loop from being preempted by the rest of the
+   system: it can be pinned to some CPUs, run with a real-time priority
+   and have its memory locked so that no frame waits for a page fault.
+   Threads started afterwards (Skeltrack's and the Kinect's) inherit the
+   affinity, so this is done before any of them exists. The real-time
+   priority is only given to the calling thread, the one receiving the
+   frames and sending the X events, and is not passed on to the threads
+   it starts. */
+
+#define _GNU_SOURCE
+
+#include "realtime.h"
+
+#include <errno.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <linux/capability.h>
+#include <gio/gio.h>
+
+/* Delays are kept in a histogram of JITTER_BIN_SIZE µs bins,
+   the last one taking anything later */
+#define JITTER_BIN_SIZE 100
+#define JITTER_N_BINS 1000
+
+struct _RealtimeJitter
+{
+  gint64 period;
+  /* Frames are expected at start_time + n * period */
+  gint64 start_time;
+  gint64 n_periods;
+  guint n_frames;
+  guint n_late;
+  gint64 total;
+  gint64 max;
+  guint bins[JITTER_N_BINS];
+};
+
+/* Parses a list such as "2,3" or "0-1,4" */
+static gboolean
+parse_cpus (const gchar *cpus, cpu_set_t *set)
+{
+  gchar **ranges;
+  guint i;
+  gboolean valid = TRUE;
+
+  CPU_ZERO (set);
+  ranges = g_strsplit (cpus, ",", -1);
+  for (i = 0; valid && ranges[i] != NULL; i++)
+    {
+      gchar *end;
+      guint64 first, last;
+
+      first = g_ascii_strtoull (ranges[i], &end, 10);
+      last = first;
+      if (end != ranges[i] && *end == '-')
+        {
+          gchar *start = end + 1;
+
+          last = g_ascii_strtoull (start, &end, 10);
+          if (end == start)
+            end = ranges[i];
+        }
+
+      valid = end != ranges[i] && *end == '\0' &&
+        first <= last && last < CPU_SETSIZE;
+      for (; valid && first <= last; first++)
+        CPU_SET (first, set);
+    }
+  g_strfreev (ranges);
+
+  return valid && CPU_COUNT (set) > 0;
+}
+
+gboolean
+realtime_set_affinity (const gchar *cpus, GError **error)
+{
+  cpu_set_t set;
+
+  g_return_val_if_fail (cpus != NULL, FALSE);
+
+  if (! parse_cpus (cpus, &set))
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                   "Invalid list of CPUs: %s", cpus);
+      return FALSE;
+    }
+
+  if (sched_setaffinity (0, sizeof (set), &set) != 0)
+    {
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+                   "Cannot run on CPUs %s: %s", cpus, g_strerror (errno));
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+gboolean
+realtime_set_priority (gint priority, GError **error)
+{
+  struct sched_param param;
+  gint min, max, res;
+
+  min = sched_get_priority_min (SCHED_FIFO);
+  max = sched_get_priority_max (SCHED_FIFO);
+  if (priority < min || priority > max)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                   "The real-time priority must be between %d and %d",
+                   min, max);
+      return FALSE;
+    }
+
+  /* Threads started from this one would otherwise inherit the policy
+     and could starve it, so they are reset to the normal one */
+  memset (&param, 0, sizeof (param));
+  param.sched_priority = priority;
+  res = pthread_setschedparam (pthread_self (),
+                               SCHED_FIFO | SCHED_RESET_ON_FORK,
+                               &param);
+  if (res != 0)
+    {
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (res),
+                   "Cannot use real-time priority %d: %s",
+                   priority, g_strerror (res));
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+/* Whether the effective capabilities include CAP_IPC_LOCK, which lifts
+   the limit on locked memory */
+static gboolean
+can_lock_unlimited (void)
+{
+  struct __user_cap_header_struct header;
+  struct __user_cap_data_struct data[_LINUX_CAPABILITY_U32S_3];
+
+  memset (&header, 0, sizeof (header));
+  header.version = _LINUX_CAPABILITY_VERSION_3;
+  if (syscall (SYS_capget, &header, data) != 0)
+    return FALSE;
+
+  return (data[CAP_TO_INDEX (CAP_IPC_LOCK)].effective &
+          CAP_TO_MASK (CAP_IPC_LOCK)) != 0;
+}
+
+gboolean
+realtime_lock_memory (GError **error)
+{
+  struct rlimit limit;
+
+  /* Frames are allocated all the time, so the pages to come must be
+     locked too; if that is limited, allocations would start failing
+     once the limit is reached, so nothing is locked instead */
+  if (! can_lock_unlimited () &&
+      getrlimit (RLIMIT_MEMLOCK, &limit) == 0 &&
+      limit.rlim_cur != RLIM_INFINITY)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_PERMISSION_DENIED,
+                   "Cannot lock the memory: limited to %lu kB "
+                   "without CAP_IPC_LOCK",
+                   (gulong) (limit.rlim_cur / 1024));
+      return FALSE;
+    }
+
+  if (mlockall (MCL_CURRENT | MCL_FUTURE) != 0)
+    {
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+                   "Cannot lock the memory: %s", g_strerror (errno));
+      return FALSE;
+    }
+
+  /* Keep the frames' memory in the heap once freed, instead of
+     mapping (and faulting in) new pages for every frame */
+  mallopt (M_MMAP_THRESHOLD, 16 * 1024 * 1024);
+  mallopt (M_TRIM_THRESHOLD, -1);
+
+  return TRUE;
+}
+
+RealtimeJitter *
+realtime_jitter_new (gint64 period)
+{
+  RealtimeJitter *jitter;
+
+  g_return_val_if_fail (period > 0, NULL);
+
+  jitter = g_slice_new0 (RealtimeJitter);
+  jitter->period = period;
+
+  return jitter;
+}
+
+void
+realtime_jitter_free (RealtimeJitter *jitter)
+{
+  g_return_if_fail (jitter != NULL);
+
+  g_slice_free (RealtimeJitter, jitter);
+}
+
+/* Records that a frame was received at TIME, in microseconds. Its delay
+   is measured against the time it was due, so that a single late frame
+   does not make the next one look early. */
+void
+realtime_jitter_add_frame (RealtimeJitter *jitter, gint64 time)
+{
+  gint64 delay;
+
+  g_return_if_fail (jitter != NULL);
+
+  if (jitter->start_time == 0)
+    {
+      jitter->start_time = time;
+      jitter->n_periods = 0;
+      return;
+    }
+
+  jitter->n_periods++;
+  delay = time - (jitter->start_time + jitter->n_periods * jitter->period);
+  if (delay < 0)
+    {
+      /* Earlier than any frame so far: the frames are due from here on */
+      jitter->start_time = time;
+      jitter->n_periods = 0;
+      delay = 0;
+    }
+  else if (delay >= jitter->period)
+    {
+      /* A frame was dropped, count from this one */
+      jitter->start_time = time;
+      jitter->n_periods = 0;
+    }
+
+  jitter->n_frames++;
+  jitter->total += delay;
+  jitter->max = MAX (jitter->max, delay);
+  if (delay > jitter->period / 2)
+    jitter->n_late++;
+  jitter->bins[MIN (delay / JITTER_BIN_SIZE, JITTER_N_BINS - 1)]++;
+}
+
+guint
+realtime_jitter_get_n_frames (RealtimeJitter *jitter)
+{
+  g_return_val_if_fail (jitter != NULL, 0);
+
+  return jitter->n_frames;
+}
+
+/* Fills STATS with the frames added since the last call */
+void
+realtime_jitter_take_stats (RealtimeJitter      *jitter,
+                            RealtimeJitterStats *stats)
+{
+  guint i, count, rank;
+
+  g_return_if_fail (jitter != NULL && stats != NULL);
+
+  memset (stats, 0, sizeof (RealtimeJitterStats));
+  if (jitter->n_frames == 0)
+    return;
+
+  stats->n_frames = jitter->n_frames;
+  stats->mean = jitter->total / jitter->n_frames;
+  stats->max = jitter->max;
+  stats->n_late = jitter->n_late;
+
+  /* The upper end of the bin holding the 99th percentile */
+  rank = (jitter->n_frames * 99 + 99) / 100;
+  for (i = 0, count = 0; i < JITTER_N_BINS; i++)
+    {
+      count += jitter->bins[i];
+      if (count >= rank)
+        break;
+    }
+  stats->p99 = MIN ((gint64) (i + 1) * JITTER_BIN_SIZE, jitter->max);
+
+  jitter->n_frames = 0;
+  jitter->n_late = 0;
+  jitter->total = 0;
+  jitter->max = 0;
+  memset (jitter->bins, 0, sizeof (jitter->bins));
+}
@@ -0,0 +1,61 @@
+/* Skeltrack Desktop Control: Real-time
+ *
+ * Copyright (c) 2012 Igalia, S.L.
+ *
+ * Author: Joaquim Rocha <jrocha@igalia.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef __REALTIME_H__
+#define __REALTIME_H__
+
+#include <glib.h>
+
+/* How late each frame arrived compared to when it was due,
+   over the frames since the last report. In microseconds. */
+typedef struct
+{
+  guint n_frames;
+  gint64 mean;
+  gint64 p99;
+  gint64 max;
+  /* Frames that arrived more than half a period late */
+  guint n_late;
+} RealtimeJitterStats;
+
+typedef struct _RealtimeJitter RealtimeJitter;
+
+gboolean         realtime_set_affinity      (const gchar  *cpus,
+                                             GError      **error);
+
+gboolean         realtime_set_priority      (gint          priority,
+                                             GError      **error);
+
+gboolean         realtime_lock_memory       (GError      **error);
+
+RealtimeJitter * realtime_jitter_new        (gint64        period);
+
+void             realtime_jitter_free       (RealtimeJitter *jitter);
+
+void             realtime_jitter_add_frame  (RealtimeJitter *jitter,
+                                             gint64          time);
+
+guint            realtime_jitter_get_n_frames (RealtimeJitter *jitter);
+
+void             realtime_jitter_take_stats (RealtimeJitter      *jitter,
+                                             RealtimeJitterStats *stats);
+
+#endif /* __REALTIME_H__ */
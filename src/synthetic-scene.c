@@ -0,0 +1,1084 @@
+/* Skeltrack Desktop Control: Synthetic Scene
+ *
+ * Copyright (c) 2012 Igalia, S.L.
+ *
+ * Author: Joaquim Rocha <jrocha@igalia.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Renders depth frames of a person made of spheres, as the Kinect would
+   see it, moving the hands as told by a script. Scripts are text files
+   with one command per line (durations in milliseconds, distances in
+   millimeters, the Y axis pointing up):
+
+     body X Y DISTANCE         Position of the head (before any movement)
+     wall DISTANCE             Wall behind the person, 0 for none
+     noise SIGMA               Depth noise at 1 m, grows with the distance
+     dropout FRACTION          Pixels without a reading
+     clutter N                 Boxes scattered around the person
+     seed N                    Seed for the noise and the clutter
+     mode wheel|pinch          Double hand mode to use
+     grab                      Turns on grab mode, closing the hand that
+                               moves the pointer to press the button
+     threshold BEGIN END       Depths given to Skeltrack (default: from
+                               1000 in front of the head to 500 behind)
+     threshold auto BEGIN END  Starts from those depths and follows the
+                               person as the demo does
+
+     wait MS
+     hand left|right X Y FORWARD MS
+                               Moves a hand relative to its shoulder,
+                               FORWARD being the distance in front of it
+     raise left|right MS       Moves a hand into the action area
+     rest left|right MS        Lowers a hand
+     move left|right DX DY MS  Moves the pointer with that hand
+     click left|right          Clicks with the other hand
+     drag left|right DX DY MS  Drags with the other hand holding the button
+     wheel left|right MS       Turns the steering wheel to a side
+     pinch in|out MS           Zooms with both hands
+     open left|right           Opens that hand, fingers spread
+     close left|right          Closes that hand into a fist, as hands are
+                               to begin with
+
+     expect motion|click BUTTON|press BUTTON|release BUTTON|
+            key KEYSYM|scroll up|down [within FRAMES]
+                               Events the script must produce, in order;
+                               with "within", no later than FRAMES frames
+                               after that point of the script
+
+   Hands are named by the side of the depth image they are on, which
+   Skeltrack reports as left and right respectively. */
+
+#include "synthetic-scene.h"
+
+#include <math.h>
+#include <string.h>
+#include <X11/Xlib.h>
+
+#define HEAD_RADIUS 100
+#define HAND_RADIUS 55
+#define PALM_RADIUS 40
+#define FINGER_RADIUS 9
+#define ARM_RADIUS 45
+#define ARM_SEGMENT_LENGTH 300
+#define TORSO_RADIUS 150
+#define LEG_RADIUS 75
+#define SHOULDER_WIDTH 190
+
+/* Kinect's focal length for 640x480, scaled for other sizes */
+#define FOCAL_LENGTH_640 594.21
+
+enum
+{
+  LEFT,
+  RIGHT
+};
+
+typedef struct
+{
+  /* Relative to the shoulder, Y up */
+  gdouble x;
+  gdouble y;
+  gdouble forward;
+} HandPose;
+
+typedef struct
+{
+  gint64 time;
+  HandPose hands[2];
+  /* Open hands from this keyframe to the next one */
+  gboolean open[2];
+} Keyframe;
+
+typedef struct
+{
+  InputEventType type;
+  guint code;
+  /* In microseconds, 0 for any time after the previous event */
+  gint64 start;
+  gint64 end;
+} Expectation;
+
+typedef struct
+{
+  gdouble x0;
+  gdouble y0;
+  gdouble x1;
+  gdouble y1;
+  gdouble z;
+} Box;
+
+typedef struct
+{
+  gdouble fx;
+  gdouble fy;
+  gdouble cx;
+  gdouble cy;
+} Camera;
+
+struct _SyntheticScene
+{
+  /* Camera coordinates: Y down, Z away from the sensor */
+  gdouble head_x;
+  gdouble head_y;
+  gdouble head_z;
+  gdouble wall;
+  gdouble noise;
+  gdouble dropout;
+  /* 0 to follow the head */
+  gdouble threshold_begin;
+  gdouble threshold_end;
+  gboolean auto_threshold;
+  guint32 seed;
+  gboolean pinch_mode;
+  gboolean grab_mode;
+
+  GArray *keyframes;
+  GArray *clutter;
+  GArray *expectations;
+
+  /* Pose at the end of the script read so far */
+  HandPose pose[2];
+  gboolean open[2];
+  gint64 time;
+};
+
+static const HandPose rest_pose[2] =
+{
+  { -60, -550, 40 },
+  { 60, -550, 40 }
+};
+
+static const HandPose action_pose[2] =
+{
+  { 120, 0, 450 },
+  { -120, 0, 450 }
+};
+
+static void
+add_keyframe (SyntheticScene *scene, gint64 duration)
+{
+  Keyframe keyframe;
+
+  scene->time += MAX (duration, 0);
+  keyframe.time = scene->time;
+  keyframe.hands[LEFT] = scene->pose[LEFT];
+  keyframe.hands[RIGHT] = scene->pose[RIGHT];
+  keyframe.open[LEFT] = scene->open[LEFT];
+  keyframe.open[RIGHT] = scene->open[RIGHT];
+  g_array_append_val (scene->keyframes, keyframe);
+}
+
+static void
+add_expectation (SyntheticScene *scene, InputEventType type, guint code)
+{
+  Expectation expectation = { type, code, 0, 0 };
+
+  g_array_append_val (scene->expectations, expectation);
+}
+
+static gboolean
+parse_hand (const gchar *name, gint *hand)
+{
+  if (g_strcmp0 (name, "left") == 0)
+    *hand = LEFT;
+  else if (g_strcmp0 (name, "right") == 0)
+    *hand = RIGHT;
+  else
+    return FALSE;
+
+  return TRUE;
+}
+
+static gboolean
+parse_numbers (gchar **args, guint n_args, gdouble *numbers)
+{
+  guint i;
+
+  for (i = 0; i < n_args; i++)
+    {
+      gchar *end;
+
+      if (args[i] == NULL)
+        return FALSE;
+
+      numbers[i] = g_ascii_strtod (args[i], &end);
+      if (*end != '\0')
+        return FALSE;
+    }
+
+  return args[n_args] == NULL;
+}
+
+static gboolean
+parse_expectation (SyntheticScene *scene, gchar **args)
+{
+  gdouble button;
+
+  if (g_strcmp0 (args[0], "motion") == 0 && args[1] == NULL)
+    {
+      add_expectation (scene, INPUT_EVENT_MOTION, 0);
+    }
+  else if (g_strcmp0 (args[0], "click") == 0 &&
+           parse_numbers (args + 1, 1, &button))
+    {
+      add_expectation (scene, INPUT_EVENT_BUTTON_PRESS, button);
+      add_expectation (scene, INPUT_EVENT_BUTTON_RELEASE, button);
+    }
+  else if (g_strcmp0 (args[0], "press") == 0 &&
+           parse_numbers (args + 1, 1, &button))
+    {
+      add_expectation (scene, INPUT_EVENT_BUTTON_PRESS, button);
+    }
+  else if (g_strcmp0 (args[0], "release") == 0 &&
+           parse_numbers (args + 1, 1, &button))
+    {
+      add_expectation (scene, INPUT_EVENT_BUTTON_RELEASE, button);
+    }
+  else if (g_strcmp0 (args[0], "scroll") == 0 && args[1] != NULL &&
+           args[2] == NULL)
+    {
+      /* Buttons 4 and 5 are the mouse wheel */
+      if (g_strcmp0 (args[1], "up") == 0)
+        button = 4;
+      else if (g_strcmp0 (args[1], "down") == 0)
+        button = 5;
+      else
+        return FALSE;
+      add_expectation (scene, INPUT_EVENT_BUTTON_PRESS, button);
+      add_expectation (scene, INPUT_EVENT_BUTTON_RELEASE, button);
+    }
+  else if (g_strcmp0 (args[0], "key") == 0 && args[1] != NULL &&
+           args[2] == NULL)
+    {
+      KeySym keysym = XStringToKeysym (args[1]);
+      if (keysym == NoSymbol)
+        return FALSE;
+      add_expectation (scene, INPUT_EVENT_KEY_PRESS, keysym);
+    }
+  else
+    {
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+/* An expectation followed by "within FRAMES" */
+static gboolean
+parse_timed_expectation (SyntheticScene *scene, gchar **args)
+{
+  guint i, n_args, first;
+  gdouble frames;
+  gchar *within;
+  gboolean valid;
+
+  n_args = g_strv_length (args);
+  if (n_args < 3 || g_strcmp0 (args[n_args - 2], "within") != 0)
+    return parse_expectation (scene, args);
+
+  if (! parse_numbers (args + n_args - 1, 1, &frames) || frames < 1)
+    return FALSE;
+
+  first = scene->expectations->len;
+  within = args[n_args - 2];
+  args[n_args - 2] = NULL;
+  valid = parse_expectation (scene, args);
+  args[n_args - 2] = within;
+
+  for (i = first; valid && i < scene->expectations->len; i++)
+    {
+      Expectation *expectation;
+
+      expectation = &g_array_index (scene->expectations, Expectation, i);
+      expectation->start = scene->time * 1000;
+      expectation->end = expectation->start +
+        frames * G_USEC_PER_SEC / SYNTHETIC_SCENE_FPS;
+    }
+
+  return valid;
+}
+
+static void
+raise_both_hands (SyntheticScene *scene, gdouble spread)
+{
+  scene->pose[LEFT] = action_pose[LEFT];
+  scene->pose[RIGHT] = action_pose[RIGHT];
+  scene->pose[LEFT].x -= spread;
+  scene->pose[RIGHT].x += spread;
+  add_keyframe (scene, 200);
+  /* The gestures skip the frame where both hands enter */
+  add_keyframe (scene, 200);
+}
+
+static void
+lower_both_hands (SyntheticScene *scene)
+{
+  scene->pose[LEFT] = rest_pose[LEFT];
+  scene->pose[RIGHT] = rest_pose[RIGHT];
+  add_keyframe (scene, 200);
+}
+
+static gboolean
+parse_command (SyntheticScene *scene, gchar **args)
+{
+  const gchar *command = args[0];
+  gdouble n[4];
+  gint hand;
+
+  if (g_strcmp0 (command, "expect") == 0)
+    return args[1] != NULL && parse_timed_expectation (scene, args + 1);
+
+  if (g_strcmp0 (command, "body") == 0 && parse_numbers (args + 1, 3, n))
+    {
+      scene->head_x = n[0];
+      scene->head_y = -n[1];
+      scene->head_z = n[2];
+    }
+  else if (g_strcmp0 (command, "wall") == 0 &&
+           parse_numbers (args + 1, 1, n))
+    {
+      scene->wall = n[0];
+    }
+  else if (g_strcmp0 (command, "threshold") == 0 &&
+           parse_numbers (args + 1, 2, n) && n[0] >= 0 && n[1] > n[0])
+    {
+      scene->threshold_begin = n[0];
+      scene->threshold_end = n[1];
+    }
+  else if (g_strcmp0 (command, "threshold") == 0 &&
+           g_strcmp0 (args[1], "auto") == 0 &&
+           parse_numbers (args + 2, 2, n) && n[0] >= 0 && n[1] > n[0])
+    {
+      scene->threshold_begin = n[0];
+      scene->threshold_end = n[1];
+      scene->auto_threshold = TRUE;
+    }
+  else if (g_strcmp0 (command, "noise") == 0 &&
+           parse_numbers (args + 1, 1, n))
+    {
+      scene->noise = n[0];
+    }
+  else if (g_strcmp0 (command, "dropout") == 0 &&
+           parse_numbers (args + 1, 1, n))
+    {
+      scene->dropout = CLAMP (n[0], 0, 1);
+    }
+  else if (g_strcmp0 (command, "seed") == 0 &&
+           parse_numbers (args + 1, 1, n))
+    {
+      scene->seed = n[0];
+    }
+  else if (g_strcmp0 (command, "clutter") == 0 &&
+           parse_numbers (args + 1, 1, n))
+    {
+      GRand *rand = g_rand_new_with_seed (scene->seed);
+      gint i;
+
+      for (i = 0; i < n[0]; i++)
+        {
+          Box box;
+          gdouble side;
+
+          /* Out of the person's way, at any depth */
+          side = g_rand_int_range (rand, 0, 2) ? 1 : -1;
+          box.z = g_rand_double_range (rand, 800, 4000);
+          box.x0 = scene->head_x + side *
+            g_rand_double_range (rand, 500, 1500) * box.z / 2000;
+          box.x1 = box.x0 + side * g_rand_double_range (rand, 100, 800);
+          box.y0 = g_rand_double_range (rand, -1000, 1000);
+          box.y1 = box.y0 + g_rand_double_range (rand, 100, 800);
+          if (box.x1 < box.x0)
+            {
+              gdouble tmp = box.x0;
+              box.x0 = box.x1;
+              box.x1 = tmp;
+            }
+          g_array_append_val (scene->clutter, box);
+        }
+
+      g_rand_free (rand);
+    }
+  else if (g_strcmp0 (command, "grab") == 0 && args[1] == NULL)
+    {
+      scene->grab_mode = TRUE;
+    }
+  else if (g_strcmp0 (command, "mode") == 0 && args[1] != NULL &&
+           args[2] == NULL)
+    {
+      if (g_strcmp0 (args[1], "pinch") == 0)
+        scene->pinch_mode = TRUE;
+      else if (g_strcmp0 (args[1], "wheel") == 0)
+        scene->pinch_mode = FALSE;
+      else
+        return FALSE;
+    }
+  else if (g_strcmp0 (command, "wait") == 0 &&
+           parse_numbers (args + 1, 1, n))
+    {
+      add_keyframe (scene, n[0]);
+    }
+  else if (g_strcmp0 (command, "hand") == 0 && parse_hand (args[1], &hand) &&
+           parse_numbers (args + 2, 4, n))
+    {
+      scene->pose[hand].x = n[0];
+      scene->pose[hand].y = n[1];
+      scene->pose[hand].forward = n[2];
+      add_keyframe (scene, n[3]);
+    }
+  else if (g_strcmp0 (command, "raise") == 0 && parse_hand (args[1], &hand) &&
+           parse_numbers (args + 2, 1, n))
+    {
+      scene->pose[hand] = action_pose[hand];
+      add_keyframe (scene, n[0]);
+    }
+  else if (g_strcmp0 (command, "rest") == 0 && parse_hand (args[1], &hand) &&
+           parse_numbers (args + 2, 1, n))
+    {
+      scene->pose[hand] = rest_pose[hand];
+      add_keyframe (scene, n[0]);
+    }
+  else if (g_strcmp0 (command, "move") == 0 && parse_hand (args[1], &hand) &&
+           parse_numbers (args + 2, 3, n))
+    {
+      scene->pose[hand].x += n[0];
+      scene->pose[hand].y += n[1];
+      add_keyframe (scene, n[2]);
+    }
+  else if (g_strcmp0 (command, "click") == 0 && parse_hand (args[1], &hand) &&
+           args[2] == NULL)
+    {
+      /* The other hand goes in and out before the gesture timeout */
+      gint other = 1 - hand;
+      HandPose pose = scene->pose[other];
+
+      scene->pose[other] = action_pose[other];
+      add_keyframe (scene, 100);
+      add_keyframe (scene, 50);
+      scene->pose[other] = pose;
+      add_keyframe (scene, 100);
+      add_keyframe (scene, 200);
+    }
+  else if (g_strcmp0 (command, "drag") == 0 && parse_hand (args[1], &hand) &&
+           parse_numbers (args + 2, 3, n))
+    {
+      /* The other hand stays in past the gesture timeout */
+      gint other = 1 - hand;
+      HandPose pose = scene->pose[other];
+
+      scene->pose[other] = action_pose[other];
+      add_keyframe (scene, 100);
+      add_keyframe (scene, 500);
+      scene->pose[hand].x += n[0];
+      scene->pose[hand].y += n[1];
+      add_keyframe (scene, n[2]);
+      scene->pose[other] = pose;
+      add_keyframe (scene, 150);
+      add_keyframe (scene, 200);
+    }
+  else if (g_strcmp0 (command, "wheel") == 0 && parse_hand (args[1], &hand) &&
+           parse_numbers (args + 2, 1, n))
+    {
+      /* The hand on the other side goes up */
+      raise_both_hands (scene, 0);
+      scene->pose[1 - hand].y += 150;
+      scene->pose[hand].y -= 150;
+      add_keyframe (scene, 300);
+      add_keyframe (scene, n[0]);
+      lower_both_hands (scene);
+    }
+  else if ((g_strcmp0 (command, "open") == 0 ||
+            g_strcmp0 (command, "close") == 0) &&
+           parse_hand (args[1], &hand) && args[2] == NULL)
+    {
+      /* From this point of the script on */
+      scene->open[hand] = g_strcmp0 (command, "open") == 0;
+      add_keyframe (scene, 0);
+    }
+  else if (g_strcmp0 (command, "pinch") == 0 && args[1] != NULL &&
+           parse_numbers (args + 2, 1, n))
+    {
+      gdouble spread;
+
+      if (g_strcmp0 (args[1], "out") == 0)
+        spread = 1;
+      else if (g_strcmp0 (args[1], "in") == 0)
+        spread = -1;
+      else
+        return FALSE;
+
+      raise_both_hands (scene, -spread * 120);
+      scene->pose[LEFT].x -= spread * 300;
+      scene->pose[RIGHT].x += spread * 300;
+      add_keyframe (scene, n[0]);
+      lower_both_hands (scene);
+    }
+  else
+    {
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+SyntheticScene *
+synthetic_scene_new (const gchar *script, GError **error)
+{
+  SyntheticScene *scene;
+  gchar *contents;
+  gchar **lines;
+  guint i;
+
+  g_return_val_if_fail (script != NULL, NULL);
+
+  if (! g_file_get_contents (script, &contents, NULL, error))
+    return NULL;
+
+  scene = g_slice_new0 (SyntheticScene);
+  scene->head_y = -250;
+  scene->head_z = 2000;
+  scene->wall = 3800;
+  scene->seed = 1;
+  scene->keyframes = g_array_new (FALSE, FALSE, sizeof (Keyframe));
+  scene->clutter = g_array_new (FALSE, FALSE, sizeof (Box));
+  scene->expectations = g_array_new (FALSE, FALSE, sizeof (Expectation));
+  scene->pose[LEFT] = rest_pose[LEFT];
+  scene->pose[RIGHT] = rest_pose[RIGHT];
+  add_keyframe (scene, 0);
+
+  lines = g_strsplit (contents, "\n", -1);
+  g_free (contents);
+
+  for (i = 0; lines[i] != NULL; i++)
+    {
+      gchar **args;
+      gchar *comment;
+      gint j, n_args;
+
+      comment = strchr (lines[i], '#');
+      if (comment != NULL)
+        *comment = '\0';
+
+      args = g_strsplit_set (g_strstrip (lines[i]), " \t", -1);
+
+      /* Drop the empty strings between consecutive spaces */
+      for (j = 0, n_args = 0; args[j] != NULL; j++)
+        {
+          if (*args[j] == '\0')
+            g_free (args[j]);
+          else
+            args[n_args++] = args[j];
+        }
+      args[n_args] = NULL;
+
+      if (n_args > 0 && ! parse_command (scene, args))
+        {
+          g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+                       "%s:%u: cannot understand \"%s\"",
+                       script, i + 1, args[0]);
+          g_strfreev (args);
+          g_strfreev (lines);
+          synthetic_scene_free (scene);
+          return NULL;
+        }
+
+      g_strfreev (args);
+    }
+
+  g_strfreev (lines);
+
+  return scene;
+}
+
+void
+synthetic_scene_free (SyntheticScene *scene)
+{
+  if (scene == NULL)
+    return;
+
+  g_array_free (scene->keyframes, TRUE);
+  g_array_free (scene->clutter, TRUE);
+  g_array_free (scene->expectations, TRUE);
+  g_slice_free (SyntheticScene, scene);
+}
+
+guint
+synthetic_scene_get_n_frames (SyntheticScene *scene)
+{
+  g_return_val_if_fail (scene != NULL, 0);
+
+  return scene->time * SYNTHETIC_SCENE_FPS / 1000 + 1;
+}
+
+/* In microseconds, like g_get_monotonic_time */
+gint64
+synthetic_scene_get_timestamp (SyntheticScene *scene, guint frame)
+{
+  return (gint64) frame * G_USEC_PER_SEC / SYNTHETIC_SCENE_FPS;
+}
+
+gboolean
+synthetic_scene_get_pinch_mode (SyntheticScene *scene)
+{
+  g_return_val_if_fail (scene != NULL, FALSE);
+
+  return scene->pinch_mode;
+}
+
+gboolean
+synthetic_scene_get_grab_mode (SyntheticScene *scene)
+{
+  g_return_val_if_fail (scene != NULL, FALSE);
+
+  return scene->grab_mode;
+}
+
+/* Whether the threshold must follow the person from the one given by
+   synthetic_scene_get_threshold */
+gboolean
+synthetic_scene_get_auto_threshold (SyntheticScene *scene)
+{
+  g_return_val_if_fail (scene != NULL, FALSE);
+
+  return scene->auto_threshold;
+}
+
+/* The depths where the person is, for the threshold */
+void
+synthetic_scene_get_threshold (SyntheticScene *scene,
+                               guint          *begin,
+                               guint          *end)
+{
+  g_return_if_fail (scene != NULL);
+
+  if (scene->threshold_end > 0)
+    {
+      *begin = scene->threshold_begin;
+      *end = scene->threshold_end;
+    }
+  else
+    {
+      *begin = MAX (scene->head_z - 1000, 0);
+      *end = scene->head_z + 500;
+    }
+}
+
+static void
+get_pose (SyntheticScene *scene, gint64 time, HandPose *hands, gboolean *open)
+{
+  Keyframe *a, *b;
+  gdouble t;
+  guint i;
+
+  for (i = 1; i < scene->keyframes->len; i++)
+    {
+      if (g_array_index (scene->keyframes, Keyframe, i).time >= time)
+        break;
+    }
+
+  if (i == scene->keyframes->len)
+    {
+      a = &g_array_index (scene->keyframes, Keyframe, i - 1);
+      hands[LEFT] = a->hands[LEFT];
+      hands[RIGHT] = a->hands[RIGHT];
+      open[LEFT] = a->open[LEFT];
+      open[RIGHT] = a->open[RIGHT];
+      return;
+    }
+
+  a = &g_array_index (scene->keyframes, Keyframe, i - 1);
+  b = &g_array_index (scene->keyframes, Keyframe, i);
+  t = b->time > a->time ? (gdouble) (time - a->time) / (b->time - a->time) : 1;
+
+  for (i = LEFT; i <= RIGHT; i++)
+    {
+      open[i] = a->open[i];
+      hands[i].x = a->hands[i].x + t * (b->hands[i].x - a->hands[i].x);
+      hands[i].y = a->hands[i].y + t * (b->hands[i].y - a->hands[i].y);
+      hands[i].forward = a->hands[i].forward +
+        t * (b->hands[i].forward - a->hands[i].forward);
+    }
+}
+
+static inline void
+set_depth (guint16 *pixel, gdouble z)
+{
+  if (z > 0 && z < G_MAXUINT16 && (*pixel == 0 || z < *pixel))
+    *pixel = (guint16) z;
+}
+
+static void
+render_sphere (guint16 *buffer,
+               guint width,
+               guint height,
+               const Camera *camera,
+               gdouble x,
+               gdouble y,
+               gdouble z,
+               gdouble radius)
+{
+  gdouble c, u_center, v_center, pixel_radius;
+  gint u, v, u0, u1, v0, v1;
+
+  if (z - radius <= 0)
+    return;
+
+  u_center = camera->cx + camera->fx * x / z;
+  v_center = camera->cy + camera->fy * y / z;
+  pixel_radius = camera->fx * radius / (z - radius) + 1;
+
+  u0 = MAX (0, (gint) (u_center - pixel_radius));
+  u1 = MIN ((gint) width - 1, (gint) (u_center + pixel_radius));
+  v0 = MAX (0, (gint) (v_center - pixel_radius));
+  v1 = MIN ((gint) height - 1, (gint) (v_center + pixel_radius));
+
+  c = x * x + y * y + z * z - radius * radius;
+
+  /* Intersection of the pixel's ray (dx, dy, 1) with the sphere */
+  for (v = v0; v <= v1; v++)
+    {
+      gdouble dy = (v - camera->cy) / camera->fy;
+
+      for (u = u0; u <= u1; u++)
+        {
+          gdouble dx, a, b, discriminant;
+
+          dx = (u - camera->cx) / camera->fx;
+          a = dx * dx + dy * dy + 1;
+          b = dx * x + dy * y + z;
+          discriminant = b * b - a * c;
+          if (discriminant < 0)
+            continue;
+
+          set_depth (&buffer[v * width + u], (b - sqrt (discriminant)) / a);
+        }
+    }
+}
+
+/* A limb is drawn as spheres along it */
+static void
+render_limb (guint16 *buffer,
+             guint width,
+             guint height,
+             const Camera *camera,
+             const gdouble *from,
+             const gdouble *to,
+             gdouble radius)
+{
+  gdouble length;
+  gint i, n;
+
+  length = sqrt ((to[0] - from[0]) * (to[0] - from[0]) +
+                 (to[1] - from[1]) * (to[1] - from[1]) +
+                 (to[2] - from[2]) * (to[2] - from[2]));
+  n = MAX (1, (gint) (length / (radius / 2)));
+
+  for (i = 0; i <= n; i++)
+    {
+      gdouble t = (gdouble) i / n;
+      render_sphere (buffer, width, height, camera,
+                     from[0] + t * (to[0] - from[0]),
+                     from[1] + t * (to[1] - from[1]),
+                     from[2] + t * (to[2] - from[2]),
+                     radius);
+    }
+}
+
+/* Places the elbow so that both segments of the arm keep their length,
+   bending it down */
+static void
+get_elbow (const gdouble *shoulder, const gdouble *hand, gdouble *elbow)
+{
+  gdouble axis[3], bend[3], distance, offset, dot, norm;
+  gint i;
+
+  for (i = 0; i < 3; i++)
+    axis[i] = hand[i] - shoulder[i];
+  distance = sqrt (axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+
+  for (i = 0; i < 3; i++)
+    elbow[i] = (shoulder[i] + hand[i]) / 2;
+
+  if (distance < 1 || distance >= 2 * ARM_SEGMENT_LENGTH)
+    return;
+
+  for (i = 0; i < 3; i++)
+    axis[i] /= distance;
+
+  /* Down (Y) without its component along the arm */
+  dot = axis[1];
+  bend[0] = -dot * axis[0];
+  bend[1] = 1 - dot * axis[1];
+  bend[2] = -dot * axis[2];
+  norm = sqrt (bend[0] * bend[0] + bend[1] * bend[1] + bend[2] * bend[2]);
+  if (norm < 1e-6)
+    return;
+
+  offset = sqrt (ARM_SEGMENT_LENGTH * ARM_SEGMENT_LENGTH -
+                 distance * distance / 4);
+  for (i = 0; i < 3; i++)
+    elbow[i] += bend[i] / norm * offset;
+}
+
+/* An open hand is a palm facing the sensor with the fingers spread
+   upwards, a closed one a ball */
+static void
+render_hand (guint16 *buffer,
+             guint width,
+             guint height,
+             const Camera *camera,
+             const gdouble *hand,
+             gboolean open,
+             gdouble side)
+{
+  gdouble base[3], tip[3];
+  gint i;
+
+  if (! open)
+    {
+      render_sphere (buffer, width, height, camera,
+                     hand[0], hand[1], hand[2], HAND_RADIUS);
+      return;
+    }
+
+  render_sphere (buffer, width, height, camera,
+                 hand[0], hand[1], hand[2], PALM_RADIUS);
+
+  /* Four fingers fanning out from the top of the palm, Y down */
+  for (i = 0; i < 4; i++)
+    {
+      gdouble spread = i - 1.5;
+
+      base[0] = hand[0] + spread * 18;
+      base[1] = hand[1] - 30;
+      base[2] = hand[2];
+      tip[0] = hand[0] + spread * 40;
+      tip[1] = hand[1] - 110;
+      tip[2] = hand[2];
+      render_limb (buffer, width, height, camera, base, tip, FINGER_RADIUS);
+    }
+
+  /* The thumb, out to the side away from the body */
+  base[0] = hand[0] + side * 30;
+  base[1] = hand[1] + 10;
+  base[2] = hand[2];
+  tip[0] = hand[0] + side * 90;
+  tip[1] = hand[1] - 30;
+  tip[2] = hand[2];
+  render_limb (buffer, width, height, camera, base, tip, FINGER_RADIUS);
+}
+
+static void
+render_person (SyntheticScene *scene,
+               const HandPose *hands,
+               const gboolean *open,
+               guint16 *buffer,
+               guint width,
+               guint height,
+               const Camera *camera)
+{
+  gdouble x = scene->head_x, y = scene->head_y, z = scene->head_z;
+  gint side;
+
+  render_sphere (buffer, width, height, camera, x, y, z, HEAD_RADIUS);
+
+  for (side = -1; side <= 1; side++)
+    {
+      gdouble top[3] = { x + side * 90, y + 250, z + 60 };
+      gdouble bottom[3] = { x + side * 90, y + 800, z + 60 };
+      render_limb (buffer, width, height, camera, top, bottom, TORSO_RADIUS);
+    }
+
+  for (side = LEFT; side <= RIGHT; side++)
+    {
+      gdouble sign = side == LEFT ? -1 : 1;
+      gdouble hip[3] = { x + sign * 100, y + 850, z + 60 };
+      gdouble foot[3] = { x + sign * 110, y + 1650, z + 60 };
+      gdouble shoulder[3] = { x + sign * SHOULDER_WIDTH, y + 230, z + 30 };
+      gdouble hand[3], elbow[3];
+
+      render_limb (buffer, width, height, camera, hip, foot, LEG_RADIUS);
+
+      hand[0] = shoulder[0] + hands[side].x;
+      hand[1] = shoulder[1] - hands[side].y;
+      hand[2] = z - hands[side].forward;
+      get_elbow (shoulder, hand, elbow);
+
+      render_limb (buffer, width, height, camera, shoulder, elbow, ARM_RADIUS);
+      render_limb (buffer, width, height, camera, elbow, hand, ARM_RADIUS);
+      render_hand (buffer, width, height, camera, hand, open[side], sign);
+    }
+}
+
+static void
+render_box (guint16 *buffer,
+            guint width,
+            guint height,
+            const Camera *camera,
+            const Box *box)
+{
+  gint u, v, u0, u1, v0, v1;
+
+  u0 = MAX (0, (gint) (camera->cx + camera->fx * box->x0 / box->z));
+  u1 = MIN ((gint) width - 1, (gint) (camera->cx + camera->fx * box->x1 / box->z));
+  v0 = MAX (0, (gint) (camera->cy + camera->fy * box->y0 / box->z));
+  v1 = MIN ((gint) height - 1, (gint) (camera->cy + camera->fy * box->y1 / box->z));
+
+  for (v = v0; v <= v1; v++)
+    for (u = u0; u <= u1; u++)
+      set_depth (&buffer[v * width + u], box->z);
+}
+
+static inline guint32
+xorshift (guint32 *state)
+{
+  *state ^= *state << 13;
+  *state ^= *state >> 17;
+  *state ^= *state << 5;
+  return *state;
+}
+
+static void
+add_noise (SyntheticScene *scene, guint frame, guint16 *buffer, gsize size)
+{
+  guint32 state, dropout;
+  gsize i;
+
+  state = (scene->seed + 1) * 2654435761u ^ (frame + 1) * 40503u;
+  if (state == 0)
+    state = 1;
+  dropout = scene->dropout * G_MAXUINT32;
+
+  for (i = 0; i < size; i++)
+    {
+      gdouble z, sigma, gaussian;
+
+      if (buffer[i] == 0)
+        continue;
+
+      if (dropout > 0 && xorshift (&state) < dropout)
+        {
+          buffer[i] = 0;
+          continue;
+        }
+
+      if (scene->noise <= 0)
+        continue;
+
+      /* The sum of four uniforms is close enough to a gaussian
+         with variance 1/3 */
+      gaussian = ((gdouble) xorshift (&state) + xorshift (&state) +
+                  xorshift (&state) + xorshift (&state)) / G_MAXUINT32 - 2;
+      z = buffer[i];
+      sigma = scene->noise * z * z / 1e6;
+      z += gaussian * sigma * 1.732;
+      buffer[i] = CLAMP (z, 1, G_MAXUINT16);
+    }
+}
+
+/* Renders the frame in millimeters, like GFREENECT_DEPTH_FORMAT_MM,
+   at any size */
+void
+synthetic_scene_render (SyntheticScene *scene,
+                        guint frame,
+                        guint16 *buffer,
+                        guint width,
+                        guint height)
+{
+  HandPose hands[2];
+  gboolean open[2];
+  Camera camera;
+  guint i;
+
+  g_return_if_fail (scene != NULL && buffer != NULL);
+
+  camera.fx = FOCAL_LENGTH_640 * width / 640;
+  camera.fy = camera.fx;
+  camera.cx = width / 2.0;
+  camera.cy = height / 2.0;
+
+  if (scene->wall > 0)
+    {
+      gsize j;
+      for (j = 0; j < (gsize) width * height; j++)
+        buffer[j] = scene->wall;
+    }
+  else
+    {
+      memset (buffer, 0, (gsize) width * height * sizeof (guint16));
+    }
+
+  for (i = 0; i < scene->clutter->len; i++)
+    render_box (buffer, width, height, &camera,
+                &g_array_index (scene->clutter, Box, i));
+
+  get_pose (scene, synthetic_scene_get_timestamp (scene, frame) / 1000,
+            hands, open);
+  render_person (scene, hands, open, buffer, width, height, &camera);
+
+  add_noise (scene, frame, buffer, (gsize) width * height);
+}
+
+/* Checks that the expected events happened in the order of the script,
+   other events in between are ignored */
+gboolean
+synthetic_scene_check_events (SyntheticScene *scene,
+                              const InputEvent *events,
+                              guint n_events,
+                              GString *report)
+{
+  guint i, j;
+
+  g_return_val_if_fail (scene != NULL, FALSE);
+
+  for (i = 0, j = 0; i < scene->expectations->len; i++)
+    {
+      Expectation *expected;
+
+      expected = &g_array_index (scene->expectations, Expectation, i);
+
+      for (; j < n_events; j++)
+        {
+          if (events[j].type == expected->type &&
+              (expected->type == INPUT_EVENT_MOTION ||
+               events[j].code == expected->code) &&
+              (expected->end == 0 ||
+               (events[j].time >= expected->start &&
+                events[j].time <= expected->end)))
+            break;
+        }
+
+      if (j == n_events)
+        {
+          if (report != NULL && expected->end != 0)
+            g_string_append_printf (report,
+                                    "expected event %u (type %d, code %u) "
+                                    "did not happen between %.3f and "
+                                    "%.3f s\n",
+                                    i + 1, expected->type, expected->code,
+                                    expected->start / 1e6,
+                                    expected->end / 1e6);
+          else if (report != NULL)
+            g_string_append_printf (report,
+                                    "expected event %u (type %d, code %u) "
+                                    "did not happen\n",
+                                    i + 1, expected->type, expected->code);
+          return FALSE;
+        }
+      j++;
+    }
+
+  return TRUE;
+}
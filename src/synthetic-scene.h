@@ -0,0 +1,64 @@
+/* Skeltrack Desktop Control: Synthetic Scene
+ *
+ * Copyright (c) 2012 Igalia, S.L.
+ *
+ * Author: Joaquim Rocha <jrocha@igalia.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __SYNTHETIC_SCENE_H__
+#define __SYNTHETIC_SCENE_H__
+
+#include <glib.h>
+
+#include "input-event.h"
+
+/* Frame rate of the Kinect's depth stream, used for the scripts' time */
+#define SYNTHETIC_SCENE_FPS 30
+
+typedef struct _SyntheticScene SyntheticScene;
+
+SyntheticScene * synthetic_scene_new             (const gchar *script,
+                                                  GError     **error);
+
+void             synthetic_scene_free            (SyntheticScene *scene);
+
+guint            synthetic_scene_get_n_frames    (SyntheticScene *scene);
+
+gboolean         synthetic_scene_get_pinch_mode  (SyntheticScene *scene);
+
+gboolean         synthetic_scene_get_grab_mode   (SyntheticScene *scene);
+
+gboolean         synthetic_scene_get_auto_threshold (SyntheticScene *scene);
+
+void             synthetic_scene_get_threshold   (SyntheticScene *scene,
+                                                  guint          *begin,
+                                                  guint          *end);
+
+gint64           synthetic_scene_get_timestamp   (SyntheticScene *scene,
+                                                  guint           frame);
+
+void             synthetic_scene_render          (SyntheticScene *scene,
+                                                  guint           frame,
+                                                  guint16        *buffer,
+                                                  guint           width,
+                                                  guint           height);
+
+gboolean         synthetic_scene_check_events    (SyntheticScene   *scene,
+                                                  const InputEvent *events,
+                                                  guint             n_events,
+                                                  GString          *report);
+
+#endif /* __SYNTHETIC_SCENE_H__ */
@@ -0,0 +1,185 @@
+/* Skeltrack Desktop Control: Work Pool
+ *
+ * Copyright (c) 2012 Igalia, S.L.
+ *
+ * Author: Joaquim Rocha <jrocha@igalia.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/* Runs a set of jobs on a few threads, each with its own data (such as
+   its own Skeltrack and gesture state), until all of them are done.
+
+   Every worker has a deque of jobs, dealt round-robin at the start. It
+   takes its jobs from the back of its own deque and, once that is empty,
+   steals from the front of the others', so workers that got the short
+   jobs help with the long ones instead of going idle. Jobs are whole
+   recordings, so a lock per deque costs nothing next to them, and no job
+   is added while running, so a worker is done when every deque is
+   empty. */
+
+#define _GNU_SOURCE
+
+#include "work-pool.h"
+
+#include <sched.h>
+#include <unistd.h>
+
+typedef struct
+{
+  GMutex mutex;
+  gpointer *jobs;
+  /* Jobs left are those from HEAD to TAIL */
+  guint head;
+  guint tail;
+} WorkQueue;
+
+typedef struct
+{
+  WorkQueue *queues;
+  guint n_workers;
+  WorkPoolFunc func;
+  gpointer user_data;
+} WorkPool;
+
+typedef struct
+{
+  WorkPool *pool;
+  guint index;
+  gpointer data;
+} Worker;
+
+/* The CPUs the process may run on, e.g. after --cpus */
+guint
+work_pool_get_n_cpus (void)
+{
+  cpu_set_t set;
+  glong n_cpus;
+
+  if (sched_getaffinity (0, sizeof (cpu_set_t), &set) == 0)
+    return MAX (1, CPU_COUNT (&set));
+
+  n_cpus = sysconf (_SC_NPROCESSORS_ONLN);
+  return n_cpus > 0 ? n_cpus : 1;
+}
+
+static gpointer
+work_queue_pop (WorkQueue *queue)
+{
+  gpointer job = NULL;
+
+  g_mutex_lock (&queue->mutex);
+  if (queue->head < queue->tail)
+    job = queue->jobs[--queue->tail];
+  g_mutex_unlock (&queue->mutex);
+
+  return job;
+}
+
+static gpointer
+work_queue_steal (WorkQueue *queue)
+{
+  gpointer job = NULL;
+
+  g_mutex_lock (&queue->mutex);
+  if (queue->head < queue->tail)
+    job = queue->jobs[queue->head++];
+  g_mutex_unlock (&queue->mutex);
+
+  return job;
+}
+
+static gpointer
+worker_run (gpointer data)
+{
+  Worker *worker = data;
+  WorkPool *pool = worker->pool;
+
+  while (TRUE)
+    {
+      gpointer job;
+      guint i;
+
+      job = work_queue_pop (&pool->queues[worker->index]);
+      for (i = 1; job == NULL && i < pool->n_workers; i++)
+        job = work_queue_steal (&pool->queues[(worker->index + i) %
+                                              pool->n_workers]);
+
+      if (job == NULL)
+        break;
+
+      pool->func (job, worker->data, pool->user_data);
+    }
+
+  return NULL;
+}
+
+/* Runs FUNC on each of the N_JOBS JOBS, on N_WORKERS threads, the
+   first of which is the calling one. Returns when all are done. */
+void
+work_pool_run (gpointer     *jobs,
+               guint         n_jobs,
+               gpointer     *worker_data,
+               guint         n_workers,
+               WorkPoolFunc  func,
+               gpointer      user_data)
+{
+  WorkPool pool;
+  Worker *workers;
+  GThread **threads;
+  guint i;
+
+  g_return_if_fail (n_workers > 0 && func != NULL);
+
+  pool.n_workers = n_workers;
+  pool.func = func;
+  pool.user_data = user_data;
+  pool.queues = g_new0 (WorkQueue, n_workers);
+  for (i = 0; i < n_workers; i++)
+    {
+      g_mutex_init (&pool.queues[i].mutex);
+      pool.queues[i].jobs = g_new (gpointer, n_jobs / n_workers + 1);
+    }
+  for (i = 0; i < n_jobs; i++)
+    {
+      WorkQueue *queue = &pool.queues[i % n_workers];
+
+      queue->jobs[queue->tail++] = jobs[i];
+    }
+
+  workers = g_new (Worker, n_workers);
+  threads = g_new (GThread *, n_workers);
+  for (i = 0; i < n_workers; i++)
+    {
+      workers[i].pool = &pool;
+      workers[i].index = i;
+      workers[i].data = worker_data[i];
+      if (i > 0)
+        threads[i] = g_thread_new ("worker", worker_run, &workers[i]);
+    }
+
+  worker_run (&workers[0]);
+  for (i = 1; i < n_workers; i++)
+    g_thread_join (threads[i]);
+
+  for (i = 0; i < n_workers; i++)
+    {
+      g_mutex_clear (&pool.queues[i].mutex);
+      g_free (pool.queues[i].jobs);
+    }
+  g_free (pool.queues);
+  g_free (workers);
+  g_free (threads);
+}
@@ -0,0 +1,41 @@
+/* Skeltrack Desktop Control: Work Pool
+ *
+ * Copyright (c) 2012 Igalia, S.L.
+ *
+ * Author: Joaquim Rocha <jrocha@igalia.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef __WORK_POOL_H__
+#define __WORK_POOL_H__
+
+#include <glib.h>
+
+/* Runs JOB on the worker whose data is WORKER_DATA */
+typedef void (*WorkPoolFunc) (gpointer job,
+                              gpointer worker_data,
+                              gpointer user_data);
+
+guint work_pool_get_n_cpus (void);
+
+void  work_pool_run        (gpointer     *jobs,
+                            guint         n_jobs,
+                            gpointer     *worker_data,
+                            guint         n_workers,
+                            WorkPoolFunc  func,
+                            gpointer      user_data);
+
+#endif /* __WORK_POOL_H__ */